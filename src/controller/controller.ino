@@ -104,6 +104,118 @@
    28 Aug 2021, V2.8, L. Shustek
     - After every few Wifi module reset attempts, drop and restore its power
       in an attempt to get it going again.
+   15 Oct 2026, not yet released as a new version
+    - Add the SIMULATE compile option, which routes the status pins, buttons, relays,
+      analog inputs, and EEPROM through a simulation of the generator and transfer switch
+      so the unmodified control logic can be exercised without them. See gensimulate.cpp.
+    - Simulations run on a virtual clock that skips ahead to the next deadline, so scripted
+      outage scenarios that span months finish quickly and report generator runtime, starts,
+      and transfer switch operations for several configurations.
+    - Add simulated regression tests that check the sequence of logged events for outages with
+      power flapping, generator and transfer switch failures, and the "at home" button,
+      and that check the web server: configuration changes, cached images, paging through
+      a log that has wrapped around, and replacing visitors in its table.
+    - Add a Linux host build in src/host, with stand-ins for the Teensy core and the EEPROM,
+      Time, and WiFiNINA libraries: the EEPROM is a file, the WiFi module is the host's TCP/IP
+      stack, and the serial port is stdin and stdout. It runs the simulator and the web server
+      without a Teensy, and "make test" there runs the regression tests.
+    - Fix: if the power failed again during generator cooldown, we stayed connected to the
+      dead utility and rested the generator. Now we start over with the generator running.
+    - Add a /stats web page that shows how many of each kind of response we generated, and
+      the bytes, writes, and time they took. In SIMULATE mode the "bench" command times them all.
+    - Count the EEPROM bytes written and actually changed, by address, and show them on the
+      /stats page with a projection of how many years the EEPROM will last at that rate.
+    - Don't log another generator start and connect every run period when the rest is cancelled
+      because of high current. That was most of the EEPROM writes during a long outage. We
+      still check that the generator is on and connected, and start it again if it isn't.
+    - Keep histograms of the time between calls to idle() and of each loop() iteration, and
+      record the recent stalls of more than 2 seconds with what we were doing at the time.
+      They are on the /stats page, and show how close we come to the watchdog timeout.
+    - Add the PROFILE compile option, which counts the CPU cycles taken by the web server,
+      the display routines, and EEPROM writes. See the /profile web page and the
+      "show profile" special operation.
+    - Keep track of the longest time between watchdog refreshes and what we were doing then,
+      and what we were doing when a watchdog reset happened. They are saved in the config,
+      shown on the /stats page, and tell us how much margin the watchdog timeout has. A new
+      longest time is written to the EEPROM later from loop(), not from the watchdog refresh,
+      and only those config bytes are written.
+    - Add the TRACE compile option, which records the changes of the status pins, buttons,
+      and analog inputs in RAM. The /trace.txt web page returns them as a simulator script,
+      and the new "replay" simulator command reruns it. It is off by default because the
+      trace buffer takes about 8K of RAM. See gentrace.cpp.
+    - Read web requests with limits on the lines, bytes, and time they take, so a broken or
+      hostile client can't overrun the line buffer or hold us for long. Overlong lines are
+      truncated, and requests that exceed the limits are dropped. The /stats page counts them,
+      and in SIMULATE mode the "fuzz" command feeds the parser all sorts of bad requests
+      and checks that it held to the limits; "make test" in the host build runs it.
+    - Paint the free RAM at startup and check periodically how much the stack has used, and
+      record the deepest stack in center_message(), assert(), and the web routines. They are
+      shown with the version info and on the /stats page, to tell us how much RAM is to spare.
+    - Collect each web response in a 4K buffer and send it to the WiFi module in chunks of up to
+      500 bytes at least 10 msec apart, as before, with smaller chunks and longer delays if the
+      module can't take them, instead of a write and a 10 msec delay for every line. The status
+      page takes 6 writes instead of 41.
+    - Send the images with an ETag that is a hash of their contents and tell browsers to cache
+      them forever. The pages refer to them with the hash in the URL, and a browser that asks
+      for an image it already has gets "304 Not Modified" instead of 20K bytes.
+    - Add a /status.json web page for monitoring programs, with the status pins, relays, voltages,
+      currents, battery, exercise, and what we're waiting for and for how long. It's written
+      by a small streaming JSON writer, and is about 400 bytes instead of the 2.6K status page.
+    - Add an /events web page that stays connected and sends Server-Sent Events when a display
+      row or the status pins, relays, or "at home" change, so one client can watch what's
+      happening live for a few dozen bytes per change.
+    - Serve up to 6 web clients at once from a table of connections, each reading its request
+      a piece at a time as it arrives. A button push waiting to show the new status, or an
+      /events watcher, no longer holds up everyone else, and several clients can watch /events.
+      A POST body ends at its Content-Length instead of after a second of silence. When all
+      the slots are busy a new client gets "503 Service Unavailable" and tries again soon.
+    - Number the log entries, with a count of all that were ever logged kept in the log header.
+      This changes the EEPROM format. A "GEN04" EEPROM is converted at startup, keeping the
+      configuration and the log, whose entries are then numbered from 1.
+      The /log page shows each entry's number, message, and extra info, and takes "?limit=N"
+      for only the newest, or "?since=S&limit=N" for the next ones after entry S. /log.json
+      returns the same as JSON, so a collector can fetch only the entries it hasn't seen.
+      The log area no longer runs 2 bytes past the end of the EEPROM.
+    - Add /log.csv, which streams the log entries as CSV, and /log.bin, which is a compact binary
+      dump of the log, configuration, and WiFi and IFTTT counters that carries its own event
+      and counter names. Both take the same "?since=S&limit=N" as /log. The new logdecode
+      program in src/logdecode merges the .bin dumps from any number of sites into CSV files.
+    - Find visitors in a hash table by IP address, and keep them in a list by most recent visit,
+      so each request no longer searches the whole table and /visitors no longer sorts it.
+      When the table is full, the visitor seen least recently is replaced, instead of the one
+      with the fewest visits. It now holds 250 visitors instead of 50, and the first visit is
+      no longer counted twice.
+    - Generate the HTML header and the main status page from constant templates: long runs of
+      text whose lengths the compiler works out, with a few typed fields in between for the
+      date, the display rows, the image versions, and the LED colors. So instead of about 35
+      formatted writes, it's mostly copying a dozen strings. A "%" on the display is no longer
+      taken as a format.
+    - Keep web connections open after a response (HTTP/1.1 keep-alive) for up to 5 seconds
+      and 20 requests, so a browser can get the status page, the button image, and the icon
+      on one connection instead of setting up three through the WiFi module. Responses say
+      how long they are, which for pages we only know when the whole page fits in the send
+      buffer; a longer one closes the connection. Requests sent together are answered in
+      order. When all the slots are busy, the connection idle longest is closed to make room.
+    - Route web requests with one switch on a hash of the method and path, computed as the
+      request line arrives, instead of trying each page in turn. The routes are case labels
+      whose hashes the compiler works out. Header names are hashed the same way, and headers
+      we don't use, like User-Agent and Cookie, are skipped without being kept.
+    - Add /metrics, which returns the WiFi, IFTTT, web, and watchdog counters, the log size,
+      the status pins and relays, the voltages and currents, and the exercise and phase timers
+      in the Prometheus text format, so a Prometheus server can scrape every site. They come
+      from one list of counters and gauges, which /log.bin now also uses for its counters.
+    - Add /config, a form to change the generator and utility times and the exercise schedule
+      from the web, and /config.json to read them or PUT new values. The password is needed
+      with each change, every value is checked before any is used, and a change is written to
+      EEPROM once and logged as "configuration updated" with the IP address it came from.
+    - Limit how often web clients are answered: each IP address gets a burst of 12 requests
+      that refills at 4 per second, and everyone together 10 that refill at 5 per second,
+      and the rest get a short "429 Too Many Requests" before any of the request is read.
+      A client's limit is kept with its entry in the visitor table. A client that gave the
+      password is exempt from the overall limit. Each process_web() call now sends at most
+      one response, taking the connections in turn, so a flood can't hold up the controller.
+      The simulator's "flood" command drives the web server with made-up clients and shows
+      the time between calls to idle() with and without the limits.
    
    Ideas:
    - better wifi rejoin attempts after power is restored (fails at the Lodge)
@@ -129,7 +241,7 @@
    ------------------------------------------------------------------------------------------------*/
 
 #include "generator.h"
-#define VERSION "2.8"
+#define VERSION "2.8+"
 
 // Here are the defaults that are put into non-volatile memory the first time.
 // They may be changed using the configuration menu.
@@ -183,6 +295,7 @@ const char *ifttt_data; // "failed", or "restored", or "test"
 int ifttt_retry_count;
 unsigned long ifttt_trytime_millis;
 time_t last_poweron_time = 0; // When power last came on, either generator or utility
+time_t startup_datetime;       // when we started
 
 const char *event_names[] = { // must match enum in generator.h
    "controller started",
@@ -205,29 +318,38 @@ typedef char event_name_error[sizeof(event_names) / sizeof(event_names[0]) == EV
 // processor running at 120 MHz, with 512K Flash, 192K RAM, and 4K EEPROM
 
 #define CONFIG_HDR_LOC 0
-struct { // local copy of the configuration data in EEPROM
-   char id[6];  // "GENnn"      // unique header ID w/ format version number
-#define ID_STRING "GEN04"       // change this to force the config and log to be rebuilt
-   unsigned short gen_delay_mins;    // how many minutes to wait before turning generator on
-   unsigned short gen_run_mins;      // how many minutes to run the generator for
-   unsigned short gen_rest_mins;     // how many minutes to rest the generator between runs
-   unsigned short gen_cooldown_mins; // how long the generator should cool down without load
-   unsigned short util_return_mins;  // how many minutes before utility is reconnected
-   byte exer_duration_mins;          // how many minutes to exercise for
-   byte exer_wday;                   // which day of the week (sun=1)
-   byte exer_hour;                   // starting at which hour (0=midnight to 23)
-   byte exer_weeks;                  // every how many weeks (1..)
-   time_t exer_last;                 // the last time we started an exercise period
-#define FOREVER 0xffff
-   unsigned short rsvd1, rsvd2, rsvd3; } config_hdr;
+struct config_hdr_t config_hdr; // local copy of the configuration data in EEPROM
 
 #define LOGFILE_HDR_LOC sizeof(config_hdr)
 struct logfile_hdr_t logfile_hdr;
 #define LOGFILE_LOC (LOGFILE_HDR_LOC+sizeof(logfile_hdr))
-#define LOG_MAX ((EEPROM_SIZE - sizeof(config_hdr)) / sizeof(struct logentry_t))
+#define LOG_MAX ((EEPROM_SIZE - LOGFILE_LOC) / sizeof(struct logentry_t))
 struct logentry_t logfile[LOG_MAX];  // the log entries
 int log_max_entries = LOG_MAX;
 
+// The previous format, which we convert at startup, had the same configuration but no num_logged
+// in the log header, and so the log started 6 bytes earlier and had room for one more entry.
+#define OLD_ID_STRING "GEN04"
+#define OLD_LOGFILE_LOC (LOGFILE_HDR_LOC + 3*sizeof(unsigned short))
+#define OLD_LOG_MAX ((EEPROM_SIZE - sizeof(config_hdr)) / sizeof(struct logentry_t))
+
+// The Teensy 3.5 emulates its EEPROM with FlexRAM that is backed up to 128K of FlexNVM flash.
+// The library doesn't rewrite bytes that aren't changing, and the emulation spreads the writes
+// of the ones that are over all of the backup flash. So what wears it out is the total rate of
+// changed bytes, wherever they are. By the formula in NXP application note AN4282, that allows
+// each location to be changed about 75,000 times if they were all changed equally often.
+#define EEPROM_BACKUP_SIZE (128 * 1024UL)  // FlexNVM used for EEPROM backup
+#define EEPROM_FLASH_CYCLES 10000UL        // its minimum program/erase cycles
+#define EEPROM_WRITE_EFFICIENCY 0.25f      // for byte writes
+#define EEPROM_ENDURANCE ((EEPROM_BACKUP_SIZE - 2 * EEPROM_SIZE) / EEPROM_SIZE * EEPROM_WRITE_EFFICIENCY * EEPROM_FLASH_CYCLES)
+unsigned long eeprom_bytes_requested = 0, eeprom_bytes_changed = 0; // since we started
+unsigned short eeprom_changes[EEPROM_SIZE]; // how often each byte changed, up to 65535
+const struct eeprom_region_t eeprom_regions[] = {
+   {"configuration", CONFIG_HDR_LOC, LOGFILE_HDR_LOC },
+   {"log header", LOGFILE_HDR_LOC, LOGFILE_LOC },
+   {"log entries", LOGFILE_LOC, EEPROM_SIZE },
+   {NULL } };
+
 //------------------------------------------------------------------------------
 //    watchdog timer routines, which cause a hard reset if we become catatonic
 //------------------------------------------------------------------------------
@@ -252,6 +374,39 @@ void watchdog_setup(unsigned msec) { // enable the watchdog timer
 uint16_t watchdog_counter(void) { // how many times the watchdog has done a reset since poweron
    return WDOG_RSTCNT; }
 
+// What we're doing is also kept in the first word of the K64 system register file, which
+// survives all resets except power-on, so that after a watchdog reset we know what caused it.
+#ifndef RFSYS_REG0
+#define RFSYS_REG0 (*(volatile uint32_t *)0x40041000)
+#endif
+#define RFSYS_ACTIVITY_ID 0x41430000 // "AC" in the high half says the low byte is an activity
+
+unsigned long watchdog_max_msec = 0; // the longest time between refreshes since startup
+byte watchdog_max_activity = ACT_NONE;
+bool watchdog_max_unsaved = false;   // is there a new record in config_hdr that isn't in EEPROM yet?
+
+void watchdog_gap(unsigned long msec) { // record the time between two refreshes
+   if (msec > watchdog_max_msec) {
+      watchdog_max_msec = msec;
+      watchdog_max_activity = activity; }
+   if (msec >= WATCHDOG_SAVE_MSEC && msec > config_hdr.watchdog_max_msec
+         && config_hdr.id[0] != 0) { // a new record, once the config has been read: save it later
+      config_hdr.watchdog_max_msec = msec > 0xffff ? 0xffff : msec;
+      config_hdr.watchdog_max_activity = activity;
+      watchdog_max_unsaved = true; } }
+
+void watchdog_save(void) { // write a new record into EEPROM, from loop() instead of the watchdog refresh
+   if (watchdog_max_unsaved) {
+      watchdog_max_unsaved = false;
+      update_config_field(&config_hdr.watchdog_max_msec, sizeof(config_hdr.watchdog_max_msec));
+      update_config_field(&config_hdr.watchdog_max_activity, sizeof(config_hdr.watchdog_max_activity)); } }
+
+byte watchdog_reset_cause(void) { // what we were doing before the reset, if we know
+   uint32_t reg = RFSYS_REG0;
+   if ((reg & 0xffff0000) == RFSYS_ACTIVITY_ID && (reg & 0xff) < ACT_NUM_ACTIVITIES)
+      return reg & 0xff;
+   return ACT_NONE; }
+
 void watchdog_poke(void) { // poke the watchdog to prevent a reset
    // The K64 processor has a bug: if you refresh the watchdog timer too frequently (more than once
    // per 1 msec watchdog clock timer period?) then the refresh is ignored and the watchdog timer
@@ -260,6 +415,8 @@ void watchdog_poke(void) { // poke the watchdog to prevent a reset
    // https://www.silabs.com/community/mcu/8-bit/knowledge-base.entry.html/2016/11/28/wdt_e101_-_restricti-Vqe5
    // My solution is to skip the refresh if the watchdog counter hasn't advanced by at least two.
    static uint16_t last_timerlow = 0;
+   static unsigned long last_refresh_micros = 0;
+   bool refreshed = false;
    noInterrupts();
    uint16_t current_timerlow = WDOG_TMROUTL;
    if ((uint16_t)(current_timerlow - last_timerlow) > 2
@@ -267,8 +424,13 @@ void watchdog_poke(void) { // poke the watchdog to prevent a reset
       ) { // don't refresh too frequently
       last_timerlow = current_timerlow;
       WDOG_REFRESH = 0xa602; // this two-part refresh sequence must complete within 20 cycles
-      WDOG_REFRESH = 0xb480; }
-   interrupts(); }
+      WDOG_REFRESH = 0xb480;
+      refreshed = true; }
+   interrupts();
+   if (refreshed) { // measure the real time since the last refresh, even when simulating
+      unsigned long now_micros = micros();
+      if (last_refresh_micros != 0) watchdog_gap((now_micros - last_refresh_micros) / 1000);
+      last_refresh_micros = now_micros; } }
 
 //-----------------------------------------------------------------------
 //    LCD display routines
@@ -375,6 +537,7 @@ void lcddumpscreen(void) { // dump the screen image to the terminal
 }
 
 void lcdprint(char ch) {
+   PROFILE_ZONE(PZ_LCDPRINT);
    assert(lcdcol < 20 && lcdrow < 4, "bad lcdprint ch", (lcdcol << 16) | lcdrow);
    #if LCD_HW
    lcdhw.print(ch);
@@ -384,6 +547,7 @@ void lcdprint(char ch) {
    lcddumpscreen(); }
 
 void lcdprint(const char *msg) {
+   PROFILE_ZONE(PZ_LCDPRINT);
    int length = strlen(msg);
    if (length > 20 - lcdcol) {
       Serial.print(length); Serial.print("=len, lcdcol="); Serial.println(lcdcol);
@@ -432,6 +596,7 @@ void assert (bool test, const char *msg) {
    assert(test, msg, 0); }
 
 void assert (bool test, const char *msg, short int extra_info) {
+   stack_note(SP_ASSERT, stack_depth());
    if (!test) {
       lcdclear(); lcdprint("** INTERNAL ERROR **");
       lcdprint(1, "Assertion failed:");
@@ -451,6 +616,8 @@ void assert (bool test, const char *msg, short int extra_info) {
          while (true) idle(); }  } }
 
 void center_message (byte row, const char *msg) { // show a one- or two-line message
+   PROFILE_ZONE(PZ_CENTER_MESSAGE);
+   stack_note(SP_CENTER_MESSAGE, stack_depth());
    byte len = strlen(msg);
    assert (row < 4, "center_message 1", row);
    if (len <= 20) {
@@ -492,10 +659,17 @@ void show_error(byte event_type) {
    center_message(2, event_names[event_type]);
    delay_looksee(); }
 
+const char *phase_msg = NULL; // the time message we're showing while waiting, for the web status,
+unsigned phase_secs;          //   the time it showed,
+time_t phase_datetime;        //   and when (it's cleared when we're back in the main loop)
+
 void timeleft_message (const char *msg, unsigned long secs_left) {
    center_message(2, msg);
    unsigned secs = secs_left > 32000 ? 0  // wrapped around to negative?
                    : secs_left;
+   phase_msg = msg;
+   phase_secs = secs;
+   phase_datetime = now();
    char string[40];
    if (secs >= 3600)
       sprintf(string, "%u hr %u min %u sec", secs / 3600, (secs % 3600) / 60, secs % 60);
@@ -529,6 +703,7 @@ bool update_bool(struct persistent_bool_t *b, byte pin) {
          b->changing = false;
       else if (millis() > b->last_change_millis + BOOL_PERSIST_MSEC) { // change has persisted
          b->val = pinnow; // record the change
+         trace_pin(pin, pinnow);
          b->changing = false;
          if (b->val) return true; } }
    else if (pinnow != b->val) { // we have a tentative change
@@ -545,6 +720,7 @@ void power_switched(void) {
 
 void update_bools(void) { // update global power status booleans,
    // and keep track of the last time power was switched on
+   PROFILE_ZONE(PZ_UPDATE_BOOLS);
    if (update_bool(&util_on, UTIL_ON_PIN) && util_connected.val)
       power_switched();
    if (update_bool(&gen_on, GEN_ON_PIN) && gen_connected.val)
@@ -554,8 +730,146 @@ void update_bools(void) { // update global power status booleans,
    if (update_bool(&util_connected, UTIL_CONNECTED_PIN) && util_on.val)
       power_switched(); }
 
+//-----------------------------------------------------------------------
+//    timing of idle() intervals and loop() iterations
+//-----------------------------------------------------------------------
+
+byte activity = ACT_NONE; // what we're doing that might take a while, for stall and watchdog reports
+const char *activity_names[] = { // must match enum in generator.h
+   "none", "generator start", "generator stop", "generator connect", "utility connect",
+   "WiFi begin", "WiFi reset", "web request", "web response", "IFTTT send" };
+typedef char activity_name_error[sizeof(activity_names) / sizeof(activity_names[0]) == ACT_NUM_ACTIVITIES ? 1 : -1];
+
+struct timing_histogram_t idle_intervals, loop_times;
+struct stall_t stalls[NUM_STALLS]; // a ring of the most recent
+unsigned long num_stalls = 0;
+
+void timing_add(struct timing_histogram_t *ph, unsigned long msec) {
+   int bucket = msec == 0 ? 0 : 32 - __builtin_clz(msec); // 1 + log2(msec)
+   if (bucket >= TIMING_BUCKETS) bucket = TIMING_BUCKETS - 1;
+   ++ph->counts[bucket];
+   if (msec > ph->max_msec) ph->max_msec = msec; }
+
+void idle_timing(void *caller) { // account for the time since idle() was last called
+   // This uses the hardware's microseconds even when simulating, because it's the real
+   // elapsed time that matters for the watchdog, not the virtual time of the simulation.
+   static unsigned long last_micros = 0;
+   unsigned long now_micros = micros();
+   if (last_micros != 0) {
+      unsigned long msec = (now_micros - last_micros) / 1000;
+      timing_add(&idle_intervals, msec);
+      if (msec >= STALL_MSEC) {
+         struct stall_t *ps = &stalls[num_stalls++ % NUM_STALLS];
+         ps->datetime = now();
+         ps->msec = msec;
+         ps->activity = activity;
+         ps->web_status = web_state();
+         ps->caller = caller; } }
+   set_activity(ACT_NONE);
+   last_micros = now_micros; }
+
+void set_activity(byte act) { // say what we're about to do
+   activity = act;
+   if (WATCHDOG) RFSYS_REG0 = RFSYS_ACTIVITY_ID | act; }
+
+//-----------------------------------------------------------------------
+//    profiling of the frequently-executed code
+//-----------------------------------------------------------------------
+
+#if PROFILE
+// The times of nested zones are included in the zones that contain them, and the 32-bit
+// cycle counter wraps around in 2^32 cycles, which is 36 seconds at 120 MHz.
+
+const char *profile_zone_names[] = { // must match enum in generator.h
+   "process_web", "generate_response", "update_bools", "center_message", "lcdprint", "eeprom_write" };
+typedef char profile_zone_name_error[sizeof(profile_zone_names) / sizeof(profile_zone_names[0]) == PZ_NUM_ZONES ? 1 : -1];
+struct profile_stats_t profile_stats[PZ_NUM_ZONES];
+
+void profile_setup(void) { // start the Cortex-M4 DWT cycle counter
+   ARM_DEMCR |= ARM_DEMCR_TRCENA;
+   ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA; }
+
+void profile_add(byte zone, unsigned long cycles) {
+   struct profile_stats_t *ps = &profile_stats[zone];
+   if (ps->calls++ == 0 || cycles < ps->min_cycles) ps->min_cycles = cycles;
+   if (cycles > ps->max_cycles) ps->max_cycles = cycles;
+   ps->total_cycles += cycles; }
+
+void show_profile(void) { // show each zone that was used on its own screen
+   for (int zone = 0; zone < PZ_NUM_ZONES; ++zone) {
+      struct profile_stats_t *ps = &profile_stats[zone];
+      if (ps->calls > 0) {
+         lcdclear();
+         lcdprint(0, profile_zone_names[zone]);
+         lcdprintf(1, "%lu calls", ps->calls);
+         lcdprintf(2, "min/avg %lu/%lu", ps->min_cycles, (unsigned long)(ps->total_cycles / ps->calls));
+         lcdprintf(3, "max %lu cycles", ps->max_cycles);
+         delay_looksee(); } }
+   lcdclear(); }
+#endif
+
+//-----------------------------------------------------------------------
+//    monitoring of the RAM used by the stack
+//-----------------------------------------------------------------------
+
+// At startup we paint the unused RAM between the top of the heap and the stack with a pattern.
+// Every so often we look for the lowest word the stack has overwritten, which tells us the most
+// stack that was ever used, including the deep calls we didn't anticipate. We also record the
+// depth reached at particular places, like the recursive center_message() and the web routines.
+// Together with the depth of assert(), that tells us what an assertion failure would need,
+// since it calls process_web() from wherever it happened.
+
+extern unsigned long _estack; // the top of RAM, where the stack starts (from the linker script)
+extern char *__brkval;        // the top of the heap (from sbrk() in the Teensy core)
+#define STACK_PAINT 0xC5C5C5C5
+#define STACK_PAINT_MARGIN 64 // bytes below the current stack that we leave alone when painting
+
+const char *stack_point_names[] = { // must match enum in generator.h
+   "center_message", "assert", "process_web", "web response", "below process_web" };
+typedef char stack_point_name_error[sizeof(stack_point_names) / sizeof(stack_point_names[0]) == SP_NUM_POINTS ? 1 : -1];
+unsigned long stack_max_depth[SP_NUM_POINTS];
+uint32_t *stack_painted;  // the lowest word the stack has overwritten, as of the last check
+
+unsigned long stack_depth(void) { // how many bytes of stack are in use now
+   byte here;
+   return (unsigned long)&_estack - (unsigned long)&here; }
+
+void stack_note(byte point, unsigned long depth) { // record the deepest stack at some point in the code
+   if (depth > stack_max_depth[point]) stack_max_depth[point] = depth; }
+
+void stack_paint(void) { // fill the unused RAM with the pattern
+   byte here;
+   uint32_t *ptr = (uint32_t *)(((unsigned long)__brkval + 3) & ~3);
+   stack_painted = (uint32_t *)(((unsigned long)&here - STACK_PAINT_MARGIN) & ~3);
+   while (ptr < stack_painted) *ptr++ = STACK_PAINT; }
+
+void stack_check(void) { // find the lowest word of the painted RAM that the stack has overwritten
+   // (The heap may have grown into the bottom of it, so start at the top of the heap.)
+   uint32_t *ptr = (uint32_t *)(((unsigned long)__brkval + 3) & ~3);
+   while (ptr < stack_painted && *ptr == STACK_PAINT) ++ptr;
+   stack_painted = ptr; }
+
+unsigned long stack_max_used(void) { // the most bytes of stack that were ever used
+   return (unsigned long)&_estack - (unsigned long)stack_painted; }
+
+unsigned long ram_free(void) { // the bytes between the heap and the deepest the stack has been
+   return (unsigned long)stack_painted - (unsigned long)__brkval; }
+
+void show_memory(void) {
+   lcdclear();
+   lcdprintf(0, "RAM free %lu", ram_free());
+   lcdprintf(1, "stack max %lu", stack_max_used());
+   lcdprintf(2, "msg %lu web %lu", stack_max_depth[SP_CENTER_MESSAGE], stack_max_depth[SP_WEB_RESPONSE]);
+   lcdprintf(3, "assert+web %lu", stack_max_depth[SP_ASSERT] + stack_max_depth[SP_BELOW_PROCESS_WEB]);
+   delay_looksee(); }
+
 void idle(void) {   // the idling routine while we're waiting for something
-   if (WATCHDOG) watchdog_poke();
+   static unsigned long stack_check_micros = 0; // (real time, so simulations aren't slowed)
+   if (WATCHDOG) watchdog_poke(); // (first, so it knows what we were doing)
+   idle_timing(__builtin_return_address(0));
+   if ((micros() - stack_check_micros) / 1000 >= STACK_CHECK_MSEC) {
+      stack_check();
+      stack_check_micros = micros(); }
    update_bools();
    if (have_wifi_module) process_web(); }
 
@@ -638,6 +952,7 @@ byte check_for_button (void) {  // check for a button push (or repeat); return b
             delay (DEBOUNCE);
             button_awaiting_release[button] = true; // setup to await release later
             button_repeat_time[button] = millis() + BUTTON_REPEAT_DELAY_MSEC;
+            trace_button(button);
             if (not_athome(button)) return button; // return this button
          } }
       if (button_webpushed[button]) { // if we queued a button "push" from the web
@@ -645,6 +960,7 @@ byte check_for_button (void) {  // check for a button push (or repeat); return b
             Serial.print("web client pushed button "); Serial.println(button);
             showing_screen = false; }
          button_webpushed[button] = false;
+         trace_button(button);
          if (not_athome(button)) return button; } }
    return 0xff; }
 
@@ -677,6 +993,7 @@ bool yesno(byte row, bool return_if_menu_button, const char *msg) {
 
 float analog(byte pin, float example_value, float example_analogV) {
    unsigned raw = analogRead(pin);
+   trace_analog(pin, raw);
    return (float)raw * ANALOG_REF / 1024 * example_value / example_analogV; }
 
 int last_max_current = 0;
@@ -724,15 +1041,44 @@ void clear_battery_warning(void) {
 //-------------------------------------------------------
 
 void eeprom_write(int addr, int length, byte *srcptr) {
-   while (length--)
-      EEPROM.write(addr++, *srcptr++); }
+   PROFILE_ZONE(PZ_EEPROM_WRITE);
+   eeprom_bytes_requested += length;
+   while (length--) {
+      if (EEPROM.read(addr) != *srcptr) { // only changed bytes are actually written
+         ++eeprom_bytes_changed;
+         if (eeprom_changes[addr] < 0xffff) ++eeprom_changes[addr]; }
+      EEPROM.write(addr++, *srcptr++); } }
 
 void eeprom_read(int addr, int length, byte *dstptr) {
    while (length--)
       *dstptr++ = EEPROM.read(addr++); }
 
+void convert_old_log(void) { // convert the log of the previous EEPROM format, keeping the configuration
+   unsigned short old_hdr[3]; // num_entries, newest, oldest
+   eeprom_read(LOGFILE_HDR_LOC, sizeof(old_hdr), (byte *)old_hdr);
+   unsigned count = old_hdr[0] <= OLD_LOG_MAX && old_hdr[2] < OLD_LOG_MAX ? old_hdr[0] : 0;
+   unsigned ndx = old_hdr[2];
+   if (count > LOG_MAX) { // keep the newest ones
+      ndx = (ndx + count - LOG_MAX) % OLD_LOG_MAX;
+      count = LOG_MAX; }
+   for (unsigned entry = 0; entry < count; ++entry) { // (the last slot ran 2 bytes past the end of EEPROM)
+      eeprom_read(OLD_LOGFILE_LOC + ndx * sizeof(struct logentry_t),
+                  sizeof(struct logentry_t), (byte *)&logfile[entry]);
+      if (++ndx >= OLD_LOG_MAX) ndx = 0; }
+   logfile_hdr.num_entries = count;
+   logfile_hdr.oldest = 0;
+   logfile_hdr.newest = count > 0 ? count - 1 : 0;
+   logfile_hdr.num_logged = count; // number them from 1, since we don't know how many there were before
+   eeprom_write(LOGFILE_LOC, count * sizeof(struct logentry_t), (byte *)logfile);
+   eeprom_write(LOGFILE_HDR_LOC, sizeof(logfile_hdr), (byte *)&logfile_hdr);
+   memcpy(config_hdr.id, ID_STRING, sizeof(config_hdr.id)); // it's now in the new format
+   update_config();
+   center_message(1, "EEPROM log converted"); }
+
 void read_config(void) {
    eeprom_read(CONFIG_HDR_LOC, sizeof(config_hdr), (byte *)&config_hdr);
+   if (memcmp(config_hdr.id, OLD_ID_STRING, sizeof(config_hdr.id)) == 0
+         && digitalRead(MENU_BUTTON_PIN) != 0) convert_old_log();
    if (memcmp(config_hdr.id, ID_STRING, sizeof(config_hdr.id)) != 0
          || digitalRead(MENU_BUTTON_PIN) == 0) { // menu button during powerup reinitializes EEPROM
       // initialize the config and log
@@ -763,9 +1109,18 @@ void read_config(void) {
    center_messagef(2, "log: %d of %d", logfile_hdr.num_entries, LOG_MAX);
    delay(LOOKSEE); }
 
+float eeprom_years_left(void) { // at the rate bytes have changed since we started, or -1 if unknown
+   float secs = now() - startup_datetime;
+   if (eeprom_bytes_changed == 0 || secs < 60 * 60) return -1;
+   float changes_per_year = eeprom_bytes_changed / secs * (365.25f * 24 * 60 * 60);
+   return EEPROM_ENDURANCE * EEPROM_SIZE / changes_per_year; }
+
 void update_config(void) {
    eeprom_write(CONFIG_HDR_LOC, sizeof(config_hdr), (byte *)&config_hdr); }
 
+void update_config_field(void *field, int length) { // write just one field of the configuration
+   eeprom_write(CONFIG_HDR_LOC + ((byte *)field - (byte *)&config_hdr), length, (byte *)field); }
+
 //--------------------------------------------------------------------------
 //      event log routines
 //--------------------------------------------------------------------------
@@ -812,12 +1167,16 @@ void do_log_event(byte event_type, short int extra_info, const char *msg) {
    Serial.print(" at "); Serial.println(format_datetime(now(), true));
    showing_screen = false;
    #endif
+   #if SIMULATE
+   sim_log_event(event_type); // (so regression tests can check it)
+   #endif
    if (logfile_hdr.num_entries == 0) logfile_hdr.num_entries = 1;
    else {
       if (++logfile_hdr.newest >= LOG_MAX) logfile_hdr.newest = 0;
       if (logfile_hdr.num_entries >= LOG_MAX) {
          if (++logfile_hdr.oldest >= LOG_MAX) logfile_hdr.oldest = 0; }
       else ++logfile_hdr.num_entries; }
+   ++logfile_hdr.num_logged;
    logfile[logfile_hdr.newest].datetime = now();
    logfile[logfile_hdr.newest].event_type = event_type;
    logfile[logfile_hdr.newest].extra_info = extra_info;
@@ -830,7 +1189,7 @@ void do_log_event(byte event_type, short int extra_info, const char *msg) {
                 (byte *) &logfile[logfile_hdr.newest]); }
 
 void log_show_events(void) {
-   int num, ndx = -1;
+   int num = 0, ndx = -1;
    char string[40];
    if (logfile_hdr.num_entries == 0) {
       lcdclear(); center_message(1, "log is empty"); delay_looksee();
@@ -864,19 +1223,26 @@ void log_show_events(void) {
          memcpy(string, logfile[ndx].msg, LOG_MSGSIZE);
          string[LOG_MSGSIZE] = 0; // make sure it's 0-terminated
          center_message(3, string); } // (might overwrite 2nd line of description)
-      short int extra_info = logfile[ndx].extra_info;
-      switch (logfile[ndx].event_type) {  // display extra info
-         case EV_BATTERY_WEAK: // voltage in tenths of a volt
-         case EV_BATTERY_READ:
-            center_messagef(3, "%d.%1dV", extra_info / 10, extra_info % 10);
-            break;
-         case EV_ASSERTION:
-         case EV_MISC:
-            center_messagef(3, "%04X", extra_info);
-            break;
-         case EV_WATCHDOG_RESET:
-            center_messagef(3, "%d time%c", extra_info, extra_info > 1 ? 's' : ' ');
-            break; } } }
+      char *info = log_extra_info(&logfile[ndx]); // display extra info, if any
+      if (*info) center_message(3, info); } }
+
+char *log_extra_info(struct logentry_t *pe) { // the extra info, shown as suits the event, or ""
+   static char string[20];
+   short int extra_info = pe->extra_info;
+   string[0] = 0;
+   switch (pe->event_type) {
+      case EV_BATTERY_WEAK: // voltage in tenths of a volt
+      case EV_BATTERY_READ:
+         sprintf(string, "%d.%1dV", extra_info / 10, extra_info % 10);
+         break;
+      case EV_ASSERTION:
+      case EV_MISC:
+         sprintf(string, "%04X", (unsigned short)extra_info);
+         break;
+      case EV_WATCHDOG_RESET:
+         sprintf(string, "%d time%s", extra_info, extra_info > 1 ? "s" : "");
+         break; }
+   return string; }
 
 void clear_log(void) {
    logfile_hdr.num_entries = 0;
@@ -1196,6 +1562,7 @@ bool stop_gen_now_button(void) {
 
 bool start_generator(void) {
    idle();
+   set_activity(ACT_GEN_START);
    digitalWrite(RUN_GEN_RELAY, RELAY_ON);
    rungenrelay = true;
    log_event(EV_GEN_ON);
@@ -1211,6 +1578,7 @@ bool start_generator(void) {
 
 bool stop_generator(void) {
    idle();
+   set_activity(ACT_GEN_STOP);
    digitalWrite(RUN_GEN_RELAY, RELAY_OFF);
    rungenrelay = false;
    log_event(EV_GEN_OFF);
@@ -1226,6 +1594,7 @@ bool stop_generator(void) {
 
 bool connect_to_generator(void) {
    idle();
+   set_activity(ACT_GEN_CONNECT);
    log_event(EV_GEN_CONNECT);
    if (!gen_connected.val) {
       if (gen_on.val) {
@@ -1244,6 +1613,7 @@ bool connect_to_generator(void) {
 
 bool connect_to_utility(void) {
    idle();
+   set_activity(ACT_UTIL_CONNECT);
    log_event(EV_UTIL_CONNECT);
    if (!util_connected.val) {
       if (util_on.val) {
@@ -1271,6 +1641,7 @@ bool utility_back(bool do_delay) {
    while (do_delay && !util_connected.val && now() < util_connect_datetime) {
       center_message(0, "Await stable power");
       show_voltage_current(1);
+      sim_deadline(util_connect_datetime);
       timeleft_message("utility connect in", util_connect_datetime - now());
       if (gen_button() && yesno(2, false, "connect utility now?")) break;
       if (!util_on.val) {  // utility failed again
@@ -1288,11 +1659,12 @@ bool utility_back(bool do_delay) {
       while (do_delay && gen_on.val && now() < gen_stop_datetime) {
          center_message(0, "Generator cooldown");
          show_voltage_current(1);
+         sim_deadline(gen_stop_datetime);
          timeleft_message("generator off in", gen_stop_datetime - now());
          if (gen_button() && yesno(2, false, "stop generator now?")) break;
          if (!util_on.val) {  // utility failed again
             show_error(EV_UTIL_FAIL);
-            return false; } } }
+            return true; } } } // start over as a new outage, with the generator already running
    stop_generator();
 
    return true; }
@@ -1352,6 +1724,20 @@ void check_exercise_startstop(bool doit) {  // see if we should start or stop an
             log_event(EV_EXERCISE_END); }
          lcdclear(); } } }
 
+time_t next_exercise_time(void) { // when the next exercise should start
+   TimeElements timeparts;
+   time_t lasttime = config_hdr.exer_last;
+   if (lasttime == 0) lasttime = now() - config_hdr.exer_weeks * SECONDS_PER_WEEK;
+   time_t nexttime = lasttime; // start with the last time
+   breakTime(nexttime, timeparts); // adjust to the right weekday and hour, if necessary
+   timeparts.Wday = config_hdr.exer_wday;
+   timeparts.Hour = config_hdr.exer_hour;
+   timeparts.Minute = timeparts.Second = 0; // This is why -SECONDS_PER_HOUR below. Think about it!
+   nexttime = makeTime(timeparts);
+   while (nexttime - lasttime < config_hdr.exer_weeks * SECONDS_PER_WEEK - SECONDS_PER_HOUR) {
+      nexttime += SECONDS_PER_WEEK; } // move by weeks until it's enough beyond the last time
+   return nexttime; }
+
 void show_exercise_info (void) {
    lcdclear();
    if (config_hdr.exer_last == 0)
@@ -1364,17 +1750,7 @@ void show_exercise_info (void) {
    else {
       center_message(2, "next exercise:");
       TimeElements timeparts;
-      time_t lasttime = config_hdr.exer_last;
-      if (lasttime == 0) lasttime = now() - config_hdr.exer_weeks * SECONDS_PER_WEEK;
-      time_t nexttime = lasttime; // start with the last time
-      breakTime(nexttime, timeparts); // adjust to the right weekday and hour, if necessary
-      timeparts.Wday = config_hdr.exer_wday;
-      timeparts.Hour = config_hdr.exer_hour;
-      timeparts.Minute = timeparts.Second = 0; // This is why -SECONDS_PER_HOUR below. Think about it!
-      nexttime = makeTime(timeparts);
-      while (nexttime - lasttime < config_hdr.exer_weeks * SECONDS_PER_WEEK - SECONDS_PER_HOUR) {
-         nexttime += SECONDS_PER_WEEK; } // move by weeks until it's enough beyond the last time
-      breakTime(nexttime, timeparts);
+      breakTime(next_exercise_time(), timeparts);
       bool am = get_am(&timeparts);
       char string[40];
       sprintf(string, "%2d %3s 20%02d %2d:%02d %cM",
@@ -1443,6 +1819,7 @@ void util_failed(void) {
             break;
          center_message(0, "power went off at");
          show_datetime(1, util_off_datetime, false);
+         sim_deadline(gen_start_datetime);
          timeleft_message("generator on in", gen_start_datetime - now()); } }
 
    else  { // we started up with the generator running and/or connected
@@ -1453,10 +1830,13 @@ void util_failed(void) {
    // the loop we repeat until power returns
 
    exercising = false; // cancel an exercise period in progress
+   bool rest_cancelled = false;
    while (1) { // alternate running and (perhaps) resting the generator
-      if (!start_generator()) return;
+      if (!rest_cancelled || !gen_on.val || !gen_connected.val) { // (it should still be on and connected)
+         if (!start_generator()) return;
+         if (!connect_to_generator()) return; }
+      rest_cancelled = false;
       gen_start_datetime = now();
-      if (!connect_to_generator()) return;
       time_t gen_stop_datetime = // when we should stop it
          (gen_stay_on || athome) ? NEVER : now() + MINS_TO_SECS(config_hdr.gen_run_mins);
 
@@ -1473,6 +1853,7 @@ void util_failed(void) {
          if (!gen_stay_on && !athome && gen_stop_datetime == NEVER) // one of them must have changed
             gen_stop_datetime =
                (gen_stay_on || athome) ? NEVER : now() + MINS_TO_SECS(config_hdr.gen_run_mins);
+         sim_deadline(gen_stop_datetime);
          if (gen_stay_on || athome) timeleft_message("duration", now() - gen_start_datetime);
          else timeleft_message("generator off in", gen_stop_datetime - now()); }
 
@@ -1480,7 +1861,8 @@ void util_failed(void) {
       if (last_max_current > GEN_REST_CURRENT_LIMIT) {
          center_message(2, "current too high; ");
          center_message(3, "rest cancelled!");
-         delay_looksee(); }
+         delay_looksee();
+         rest_cancelled = true; }
       else {
          stop_generator(); // start resting
          gen_start_datetime = now() + MINS_TO_SECS((time_t) config_hdr.gen_rest_mins);
@@ -1490,6 +1872,7 @@ void util_failed(void) {
             if (start_gen_now_button()) break;
             center_message(0, "generator resting");
             center_message(1, "");
+            sim_deadline(gen_start_datetime);
             timeleft_message("will go on in", gen_start_datetime - now()); } } } }
 
 //--------------------------------------------------------------------------
@@ -1534,6 +1917,9 @@ void special_operation(void) {
       #endif
       {"do exercise?", do_exercise },
       {"show battery volts?", show_battery_volts },
+      #if PROFILE
+      {"show profile?", show_profile },
+      #endif
       {NULL, NULL } };
    for (byte cmd = 0; ; ) { //cycle through menu items
       lcdclear();
@@ -1552,7 +1938,8 @@ void special_operation(void) {
 
 void show_version_info(void) {
    show_version();
-   delay_looksee(); }
+   delay_looksee();
+   show_memory(); }
 
 void show_wifi_info(void) {
    show_wifi_mac_info();
@@ -1686,6 +2073,7 @@ void show_analog(void) {  // show analog inputs every half second
 #if WIFI
 void wifi_reset(void) {
    ++wifi_resets;
+   set_activity(ACT_WIFI_RESET);
    if (wifi_resets % MAX_WIFI_RESETS == 0) { // every few resets, drop the power
       lcdWiFi_poweroff();
       delay(500);
@@ -1701,6 +2089,15 @@ void wifi_reset(void) {
 
 
 void setup(void) {
+   byte reset_activity = watchdog_reset_cause(); // (before anything changes it)
+   stack_paint(); // (before the stack gets deep)
+
+   #if SIMULATE
+   sim_setup();
+   #endif
+   #if PROFILE
+   profile_setup();
+   #endif
 
    // configure the I/O pins
 
@@ -1723,10 +2120,13 @@ void setup(void) {
    digitalWrite(WIFI_LED, WIFI_LED_OFF); // turn off the "WiFi connected" light
    #endif
    analogReference(0);  // use 3.3V supply as reference
+   trace_startup(readpin(UTIL_ON_PIN) | readpin(GEN_ON_PIN) << 1
+                 | readpin(UTIL_CONNECTED_PIN) << 2 | readpin(GEN_CONNECTED_PIN) << 3);
 
    setSyncProvider(getTeensy3Time);
    if (now() < (time_t)30 * 365 * 24 * 60 * 60) // approx Jan 1, 2000
       set_datetime_compile(); // clock has never been initialized
+   startup_datetime = now();
 
    lcdWiFi_poweron();
    delay(200);
@@ -1765,7 +2165,10 @@ void setup(void) {
    int num_resets;
    if ((num_resets = watchdog_counter()) != 0) { // if we experienced a watchdog reset last time
       log_event(EV_WATCHDOG_RESET, num_resets);
+      config_hdr.watchdog_reset_activity = reset_activity + 1;
+      update_config_field(&config_hdr.watchdog_reset_activity, sizeof(config_hdr.watchdog_reset_activity));
       center_message(1, "Watchdog reset!");
+      center_message(2, activity_names[reset_activity]);
       delay(LOOKSEE); }
    log_event(EV_STARTUP);
    lcdclear();
@@ -1809,6 +2212,15 @@ uint32_t FreeMem() {
 //-------------------------------------------------------------------
 
 void loop(void) {
+   static unsigned long loop_start_millis = 0;
+   if (loop_start_millis != 0) timing_add(&loop_times, millis() - loop_start_millis);
+   loop_start_millis = millis();
+   phase_msg = NULL; // we're not waiting for anything
+   if (WATCHDOG) watchdog_save();
+
+   #if SIMULATE
+   sim_loop(); // start and finish simulated outage scenarios
+   #endif
 
    // show the various headline messages
 
@@ -1854,6 +2266,12 @@ void loop(void) {
    if (button == MENU_BUTTON) menu_pushed();
    if (button == GEN_BUTTON) gen_pushed();
 
+   #if SIMULATE
+   if (util_on.val) { // we're idle until the next exercise check, which could start or stop one
+      sim_deadline(now() - now() % SECONDS_PER_HOUR + SECONDS_PER_HOUR);
+      if (exercising)
+         sim_deadline(now() + MINS_TO_SECS(config_hdr.exer_duration_mins) + 1 - (millis() - exercise_start_millis) / 1000); }
+   #endif
    delay(SMIDGE); }
 
 //*
@@ -1,4 +1,5 @@
 //file: generator.h
+#pragma once
 
 // compile options
 
@@ -10,6 +11,13 @@
 #define LCD_HW true                  // do we have the LCD hardware attached?
 #define WIFI true                    // generate code to be a WiFi server and IFTTT client?
 #define WATCHDOG true                // generate code for the watchdog reset?
+#define SIMULATE false               // simulate the generator, transfer switch, and EEPROM for testing?
+#define PROFILE false                // count CPU cycles in named zones of the frequently-executed code?
+#define TRACE false                  // record the changes of the inputs, for replay in the simulator?
+#ifdef HOST                          // the Linux host build in ../host has no generator or transfer switch,
+   #undef SIMULATE                   //   so it always simulates them
+   #define SIMULATE true
+#endif
 
 #define DEBUGSER false               // special hardware serial port debugging
 #define DEBUGPORT Serial4            //   on this port
@@ -27,11 +35,15 @@
 #define POWER_ON_WEB_DELAY_SECS 120  // how many seconds to avoid web access after power returns
 #define WATCHDOG_SECS 60             // how many seconds of no action before the watchdog timer resets us
 //                                      (Note that WiFi.begin() can block for up to 50 seconds!
+#define WATCHDOG_SAVE_MSEC 1000      // save new longest times between watchdog refreshes that are at least this
 #define SMIDGE 100                   // a small polling delay, in msec
 #define LOOKSEE 2500                 // a delay for something to be seen, in msec
 #define DEBOUNCE 50                  // switch debounce delay, in msec
 #define NEVER (time_t)0x7fffffffUL   // a long time (there is confusion: time_t may be signed or unsigned!)
 #define MINS_TO_SECS(x) (USE_SECS_FOR_MINS ? x : x*60)
+#define STALL_MSEC 2000              // record the times we go this long between calls to idle()
+#define NUM_STALLS 8                 //   keeping this many of the most recent
+#define STACK_CHECK_MSEC 10000       // how often to check how much of the painted stack was used
 
 #include <Arduino.h>
 #if LCD_HW
@@ -49,8 +61,85 @@
 #include "generator_hw.h"
 #include "Wifi_names.h"  // SSID and password, etc.
 
+#if SIMULATE  // the hardware abstraction: route our I/O to the simulator in gensimulate.cpp
+   uint8_t sim_digitalRead(uint8_t pin);
+   void sim_digitalWrite(uint8_t pin, uint8_t val);
+   int sim_analogRead(uint8_t pin);
+   struct sim_eeprom_t {
+      uint8_t read(int addr);
+      void write(int addr, uint8_t val); };
+   extern struct sim_eeprom_t sim_EEPROM;
+   unsigned long sim_millis(void);
+   time_t sim_now(void);
+   void sim_setTime(time_t t);
+   void sim_delay(unsigned long msec);
+   void sim_deadline(time_t when);
+   void sim_setup(void);
+   void sim_loop(void);
+   void sim_log_event(byte event_type);
+   void web_benchmark(int repeats);
+   void web_fuzz(int count);
+   void web_flood(int secs);
+   #if WIFI
+      int web_test_request(const char *request);
+      bool web_test_response_has(const char *text);
+      bool web_test_visit(IPAddress addr, int count);
+      long web_test_visitor(IPAddress addr);
+   #endif
+   void sim_virtual_time(bool on);
+   bool sim_busy(void);
+   #ifndef SIMULATOR  // (but not in the simulator itself, which needs the real routines)
+      #define digitalRead(pin) sim_digitalRead(pin)
+      #define digitalReadFast(pin) sim_digitalRead(pin)
+      #define digitalWrite(pin, val) sim_digitalWrite(pin, val)
+      #define analogRead(pin) sim_analogRead(pin)
+      #ifndef HOST  // (whose EEPROM is a file)
+      #define EEPROM sim_EEPROM
+      #endif
+      #define millis() sim_millis()
+      #define now() sim_now()
+      #define setTime(t) sim_setTime(t)
+      #define delay(msec) sim_delay(msec)
+   #endif
+#else
+   #define sim_deadline(when)  // (tells the simulator when a wait will end)
+#endif
+
+#if TRACE  // record input changes in gentrace.cpp
+   void trace_startup(unsigned short status_pins);
+   void trace_pin(byte pin, bool val);
+   void trace_button(byte button);
+   void trace_analog(byte pin, unsigned raw);
+#else
+   #define trace_startup(status_pins)  // (compile to nothing)
+   #define trace_pin(pin, val)
+   #define trace_button(button)
+   #define trace_analog(pin, raw)
+#endif
+void trace_script(void (*output)(const char *line, void *arg), void *arg);
+
 #define SEROUT(msg) if(DEBUGSER) DEBUGPORT.println(msg)
 
+enum profile_zone_t { // the profiled zones of code: must agree with profile_zone_names[]
+   PZ_PROCESS_WEB, PZ_GENERATE_RESPONSE, PZ_UPDATE_BOOLS, PZ_CENTER_MESSAGE, PZ_LCDPRINT, PZ_EEPROM_WRITE,
+   PZ_NUM_ZONES };
+struct profile_stats_t { // what the calls of a zone took, in cycles of the DWT cycle counter
+   unsigned long calls, min_cycles, max_cycles;
+   unsigned long long total_cycles; };
+#if PROFILE
+   void profile_add(byte zone, unsigned long cycles);
+   struct profile_timer_t { // times a zone from where it is declared to the end of the enclosing block
+      byte zone;
+      unsigned long start_cycles;
+      profile_timer_t(byte z) {
+         zone = z; start_cycles = ARM_DWT_CYCCNT; }
+      ~profile_timer_t() {
+         profile_add(zone, ARM_DWT_CYCCNT - start_cycles); } };
+   #define PROFILE_ZONE(zone) struct profile_timer_t profile_timer(zone)
+#else
+   #define PROFILE_ZONE(zone)  // (compiles to nothing)
+#endif
+
 #define MAXLINE 500
 
 #define DOWNARROW   "\x01"    // glyphs we define
@@ -79,10 +168,52 @@ enum event_type_num { // log event types: must agree with event_names[]
    EV_MISC, // useful for temporary logging; the info is in the optional message
    EV_NUM_EVENTS };
 
+enum activity_t { // what we were doing before idle() was called: must agree with activity_names[]
+   ACT_NONE, ACT_GEN_START, ACT_GEN_STOP, ACT_GEN_CONNECT, ACT_UTIL_CONNECT,
+   ACT_WIFI_BEGIN, ACT_WIFI_RESET, ACT_WEB_REQUEST, ACT_WEB_RESPONSE, ACT_IFTTT_SEND,
+   ACT_NUM_ACTIVITIES };
+
+enum stack_point_t { // the places we record the stack depth: must agree with stack_point_names[]
+   SP_CENTER_MESSAGE, SP_ASSERT, SP_PROCESS_WEB, SP_WEB_RESPONSE, SP_BELOW_PROCESS_WEB,
+   SP_NUM_POINTS };
+
+#define TIMING_BUCKETS 20
+struct timing_histogram_t { // counts of times in power-of-2 msec buckets: 0, 1, 2-3, 4-7, ...
+   unsigned long counts[TIMING_BUCKETS];
+   unsigned long max_msec; };
+
+struct stall_t { // a long time between calls to idle()
+   time_t datetime;   // when it ended
+   unsigned long msec;
+   byte activity;     // what we said we were doing
+   byte web_status;   // the state of the web server
+   void *caller;      // where idle() was finally called from
+};
+
+struct config_hdr_t { // the configuration data in EEPROM
+   char id[6];  // "GENnn"      // unique header ID w/ format version number
+#define ID_STRING "GEN05"       // change this to force the config and log to be rebuilt
+   unsigned short gen_delay_mins;    // how many minutes to wait before turning generator on
+   unsigned short gen_run_mins;      // how many minutes to run the generator for
+   unsigned short gen_rest_mins;     // how many minutes to rest the generator between runs
+   unsigned short gen_cooldown_mins; // how long the generator should cool down without load
+   unsigned short util_return_mins;  // how many minutes before utility is reconnected
+   byte exer_duration_mins;          // how many minutes to exercise for
+   byte exer_wday;                   // which day of the week (sun=1)
+   byte exer_hour;                   // starting at which hour (0=midnight to 23)
+   byte exer_weeks;                  // every how many weeks (1..)
+   time_t exer_last;                 // the last time we started an exercise period
+#define FOREVER 0xffff
+   unsigned short watchdog_max_msec; // the longest time ever between watchdog refreshes
+   byte watchdog_max_activity;       //   and what we were doing then
+   byte watchdog_reset_activity;     // what we were doing at the last watchdog reset, plus 1; 0 if none
+   unsigned short rsvd3; };
+
 struct logfile_hdr_t {  // log file header info
    unsigned short num_entries;    // how many log entries are in use
    unsigned short newest;         // index of the newest
    unsigned short oldest;         // index of the oldest
+   unsigned long num_logged;      // how many were ever logged, which is the number of the newest
 };
 struct logentry_t { // the log entries
    time_t datetime;  // time of the event in seconds since 1/1/1970
@@ -93,12 +224,14 @@ struct logentry_t { // the log entries
 };
 void assert (bool test, const char *msg);
 void update_bools(void);
+void update_config(void);
 char *format_datetime(time_t thetime, bool showsecs);
 void log_event(byte event_type);
 void log_event(byte event_type, short int extra_info);
 void log_event(byte event_type, const char *msg);
 void log_event(byte event_type, short int extra_info, const char *msg);
 void log_eventf(byte event_type, const char *msg, ...);
+char *log_extra_info(struct logentry_t *pe);
 void process_web(void);
 void skip_blanks(char **pptr);
 bool scan_key(char **pptr, const char *keyword);
@@ -127,6 +260,7 @@ extern long ifttt_queues;
 extern long wifi_resets;
 extern unsigned long ifttt_trytime_millis;
 extern bool fatal_error;
+void idle(void);
 void delay_looksee(void);
 extern const char *fatal_msg;
 extern bool athome;
@@ -134,10 +268,49 @@ extern char lcdbuf[4][21];
 extern bool showing_screen;
 extern struct persistent_bool_t util_on, gen_on, util_connected, gen_connected;
 extern time_t last_poweron_time;
+extern bool rungenrelay, connectgenrelay;
+extern bool exercising;
+extern unsigned long exercise_start_millis;
+time_t next_exercise_time(void);
+extern bool do_battery_warning;
+extern float poweroff_battery_voltage;
+extern const char *phase_msg;
+extern unsigned phase_secs;
+extern time_t phase_datetime;
+float analog(byte pin, float example_value, float example_analogV);
 #define HAVE_POWER ((util_on.val && util_connected.val) || (gen_on.val && gen_connected.val))
 extern const char *event_names[];
+extern struct config_hdr_t config_hdr;
 extern struct logfile_hdr_t logfile_hdr;
 extern struct logentry_t logfile[];
 extern int log_max_entries;
+extern time_t startup_datetime;
+struct eeprom_region_t { // a part of the EEPROM we account for separately
+   const char *name;
+   int start, end; };
+extern const struct eeprom_region_t eeprom_regions[];
+extern unsigned long eeprom_bytes_requested, eeprom_bytes_changed;
+extern unsigned short eeprom_changes[];
+float eeprom_years_left(void);
+extern byte activity;
+void set_activity(byte act);
+void watchdog_poke(void);
+uint16_t watchdog_counter(void);
+extern unsigned long watchdog_max_msec;
+extern byte watchdog_max_activity;
+extern const char *activity_names[];
+extern struct timing_histogram_t idle_intervals, loop_times;
+extern struct stall_t stalls[];
+extern unsigned long num_stalls;
+unsigned long stack_depth(void);
+void stack_note(byte point, unsigned long depth);
+extern unsigned long stack_max_depth[];
+extern const char *stack_point_names[];
+unsigned long ram_free(void);
+unsigned long stack_max_used(void);
+byte web_state(void);
+extern const char *web_status_names[];
+extern const char *profile_zone_names[];
+extern struct profile_stats_t profile_stats[];
 
 //*
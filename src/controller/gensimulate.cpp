@@ -0,0 +1,937 @@
+// file: gensimulate.cpp
+/* ----------------------------------------------------------------------------------------
+   hardware simulation routines
+
+   When compiled with SIMULATE true, the macros in generator.h route all the controller's
+   reads and writes of the status pins, pushbuttons, relays, analog inputs, and EEPROM
+   to the routines here instead of to the hardware. The control logic itself is unchanged.
+
+   We simulate a "smart" generator that starts and stops a few seconds after the run relay
+   changes, and a Cummins RA-style transfer switch that follows the "connect to generator"
+   relay whenever the source it is told to connect to has power. (See the state machine
+   in the main module.) The relays are never energized, so it is safe to run a simulation
+   on a controller that is installed in a transfer switch. The LEDs, LCD display, real
+   pushbuttons, and the WiFi module all work normally.
+
+   The EEPROM is simulated in RAM and starts out blank, so the configuration is set to
+   the defaults and the log is empty. Nothing in the real EEPROM is read or changed.
+
+   The simulator also runs on Linux, without a Teensy, in the host build in ../host. There
+   the EEPROM is a file, the web server uses the host's network, and "make test" runs the
+   regression tests.
+
+   The simulated world is controlled by commands typed into the serial port, one per line:
+     util on|off      utility power is present or not
+     gen ok|fail      the generator starts normally, or refuses to start
+     gen stall        the generator stops by itself, and won't restart until "gen ok"
+     switch ok|stuck  the transfer switch moves normally, or is stuck where it is
+     load <amps>      the load current on each phase, when power is connected
+     batt <tenths>    the starter battery voltage, in tenths of a volt
+     press <button>   push a button: gen, menu, left, right, up, down, or athome
+     show             show the state of the simulated world
+     run              run all the outage scenarios below, using the current configuration
+     compare          run all the scenarios for each of the configurations below
+     test             run all the regression tests below, using the default configuration
+     stop             stop running scenarios or tests
+     bench [<count>]  time the generation of each kind of web page, using a client that
+                      discards what is sent; by default 10 of each. The "bench totals" line
+                      at the end is the sum for one of each, to compare with other builds
+     fuzz [<count>]   feed the web request parser valid, garbage, oversized, slow, endless,
+                      and stalled requests from a made-up client, show what it took and
+                      what was rejected, and check that; by default 100 of each, on the
+                      virtual clock. It ends with a "fuzz checks: n passed, n failed" line
+     flood [<secs>]   flood the web server with requests from a greedy client, a scanner,
+                      and a browser, and show how long the control loop waited for it and
+                      what each client got, without and with the admission control that
+                      limits them, and check what the limits did; by default for 10 seconds
+                      each way, in real time. It ends with a "flood checks: ..." line
+     log <count>      log that many "event:" entries, "test 1" and up, to fill the log
+     web <status> <method> <path> [| <header>]... [|| <body>]
+                      make a request of the web server from a made-up client, and check the
+                      status of the response. In the request, $etag is the last ETag we were
+                      sent, and $next is the "next" entry number from the last /log.json
+     webhas <text>    check that what we kept of the last response has the text,
+     webnot <text>      or doesn't have it
+     visit <addr> [<count>]  record visits to the web server from that many IP addresses,
+                      starting with this one, and check its visitor table after each
+     visitor <addr> <count>|gone  check how many requests the visitor table says this address
+                      made, or that it forgot the address
+     trace            show the recorded input changes as a scenario script (see gentrace.cpp)
+     replay           run the scenario script in the lines that follow, up to one with
+                      the "end" command, like a trace downloaded from a controller in the
+                      field, and show the events that are logged
+
+   The controller sees a virtual clock through millis(), now(), and delay(). Normally it
+   follows real time, but while scenarios are running, delay() doesn't wait. Instead it
+   advances the virtual clock, and if nothing is changing it skips straight ahead to the
+   next deadline that the control logic has announced with sim_deadline(), or to the next
+   scenario event or simulated hardware change if that comes sooner. That way a scenario
+   with a year of outages finishes in minutes of real time instead of a year.
+   The fuzz command also uses the virtual clock, so slow clients don't take real time. The
+   flood command doesn't, because it measures the real time the web server takes.
+
+   A scenario is a script of lines with the same commands as above, each preceded by the
+   time from the start of the scenario when it happens, like 2d3h30m for 2 days, 3 hours,
+   and 30 minutes. Lines or commands that start with # are comments. The optional "end"
+   command just marks when the scenario ends. After
+   the last line, the scenario is over once the controller is back on utility power with
+   the generator stopped. For each scenario we report the time the utility was off, the
+   generator runtime, the number of generator starts, the number of transfer switch
+   operations, the time the house was without power, and the number of EEPROM bytes changed.
+
+   A regression test is a scenario that also lists the events the control logic should
+   log, in order, separated by commas, using the names in event_names[]. Events that
+   don't come from the control logic, like WiFi and IFTTT, are ignored. A test fails at
+   the first event that doesn't match, or if some expected events never happen. The tests
+   should be rerun and checked whenever the control logic is changed. Each starts with the
+   default configuration. The web, webhas, webnot, visit, and visitor commands are checks
+   too: in a test, one that doesn't pass fails it, and when typed in, each says "ok" or
+   what was wrong.
+
+   See the main module for other details and the change log.
+   ----------------------------------------------------------------------------------------
+   Copyright (c) 2019,2020 Len Shustek
+   The MIT License (MIT)
+   Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+   and associated documentation files (the "Software"), to deal in the Software without
+   restriction, including without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in all copies or
+   substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+   BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+   DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+   ------------------------------------------------------------------------------------------------*/
+
+#define SIMULATOR  // we use the real hardware routines, not the simulated ones
+#include "generator.h"
+
+#if SIMULATE
+
+#define SIM_GEN_START_MSEC 5000   // how long the generator takes to start
+#define SIM_GEN_STOP_MSEC 2000    // how long the generator takes to stop
+#define SIM_SWITCH_MSEC 1000      // how long the transfer switch takes to change position
+#define SIM_PRESS_MSEC 200        // how long a simulated button push lasts
+#define SIM_SETTLE_MSEC (24 * 60 * 60 * 1000ULL) // how long after its last line a scenario can take to end
+#define SIM_READ_MSEC 1           // virtual time each pin read takes when running scenarios,
+//                                   so that polling loops without delays still see time pass
+#define SIM_VOLTS 240             // the utility and generator voltage, when on
+#define SIM_EPOCH 1609459200UL    // the virtual clock starts at 1 Jan 2021 00:00:00
+#define SIM_HOUR_MSEC (60 * 60 * 1000.0f)
+#define SIM_REPLAY_SIZE 16384     // the longest script we can replay
+
+static struct sim_world_t { // the state of the simulated world
+   bool util_power;     // is utility power present?
+   bool gen_fails;      // will the generator refuse to start?
+   bool gen_running;    // is the generator producing power?
+   bool gen_connected;  // is the transfer switch connected to the generator (else utility)?
+   bool switch_stuck;   // is the transfer switch unable to move?
+   bool run_relay, connect_relay;  // our relay outputs
+   int load_amps;       // load current on each phase, when power is connected
+   int batt_tenths;     // starter battery voltage, in tenths of a volt
+   unsigned long gen_change_millis;     // when the generator was last told to start or stop
+   unsigned long switch_change_millis;  // when the switch could have started to move
+   bool button_pushed[NUM_BUTTONS];     // simulated button pushes in progress
+   unsigned long button_push_millis[NUM_BUTTONS]; // when they started
+} sim = {true, false, false, false, false, false, false, 10, 126 };
+
+static const struct { // the buttons, in the same order as button_pins[] in the main module
+   const char *name;
+   byte pin; }
+sim_buttons[NUM_BUTTONS] = {
+   {"GEN", GEN_BUTTON_PIN }, {"MENU", MENU_BUTTON_PIN },
+   {"LEFT", LEFT_BUTTON_PIN }, {"RIGHT", RIGHT_BUTTON_PIN },
+   {"UP", UP_BUTTON_PIN }, {"DOWN", DOWN_BUTTON_PIN },
+   {"ATHOME", ATHOME_BUTTON_PIN } };
+
+struct sim_scenario_t {
+   const char *name;
+   const char *script;   // lines of "<time> <command>"
+   const char *events; }; // for tests, the events that should be logged
+
+static const struct sim_scenario_t sim_scenarios[] = { // the outage scenarios
+   {  "brief outage",
+      "0 util off\n"
+      "10m util on\n"
+      "1h end\n" },
+   {  "three hour outage",
+      "0 util off\n"
+      "3h util on\n"
+      "4h end\n" },
+   {  "overnight outage",
+      "0 load 20\n"
+      "0 util off\n"
+      "11h util on\n"
+      "12h end\n" },
+   {  "two day storm",
+      "0 load 30\n"
+      "0 util off\n"
+      "2d2h util on\n"
+      "2d3h end\n" },
+   {  "stormy year",
+      "12d6h util off\n"    "12d7h30m util on\n"
+      "40d14h util off\n"   "40d20h util on\n"
+      "41d2h util off\n"    "41d2h5m util on\n"
+      "75d22h util off\n"   "76d9h util on\n"
+      "110d3h util off\n"   "110d3h2m util on\n"
+      "150d18h util off\n"  "152d6h util on\n"
+      "190d12h util off\n"  "190d16h util on\n"
+      "230d1h util off\n"   "230d1h40m util on\n"
+      "260d9h util off\n"   "261d0h util on\n"
+      "300d15h util off\n"  "300d17h util on\n"
+      "330d20h util off\n"  "332d8h util on\n"
+      "365d end\n" } };
+#define NUM_SCENARIOS (sizeof(sim_scenarios) / sizeof(sim_scenarios[0]))
+
+static const struct sim_scenario_t sim_tests[] = { // the regression tests
+   {  "normal outage",
+      "0 util off\n"
+      "3h util on\n",
+      "power failed, generator start, connect to generator, generator stop, "
+      "power restored, connect to utility, generator cooldown, generator stop" },
+   {  "power flapping during generator delay",
+      "0 util off\n"
+      "20m util on\n"     "20m30s util off\n"
+      "21m util on\n"     "40m util off\n"
+      "1h util on\n"      "1h0m5s util off\n"
+      "3h util on\n",
+      "power failed, power restored, power failed, power restored, power failed, "
+      "power restored, power failed, power restored" },
+   {  "generator start failure",
+      "0 gen fail\n"
+      "0 util off\n"
+      "3h util on\n",
+      "power failed, generator start, generator didn't start, power failed, "
+      "power restored" },
+   {  "generator stalls",
+      "0 load 30\n"
+      "0 util off\n"
+      "2h10m gen stall\n"
+      "3h util on\n",
+      "power failed, generator start, connect to generator, generator stop, "
+      "power restored, connect to utility, generator cooldown, generator stop" },
+   {  "generator stalls when its rest is cancelled",
+      "0 load 30\n"
+      "0 util off\n"
+      "2h30m8s gen stall\n"
+      "2h30m20s gen ok\n"
+      "3h util on\n",
+      "power failed, generator start, connect to generator, generator start, "
+      "connect to generator, power restored, connect to utility, generator cooldown, "
+      "generator stop" },
+   {  "power unstable when it returns",
+      "0 load 30\n"
+      "0 util off\n"
+      "3h util on\n"      "3h5m util off\n"
+      "3h6m util on\n",
+      "power failed, generator start, connect to generator, power restored, "
+      "power failed, power restored, connect to utility, generator cooldown, "
+      "generator stop" },
+   {  "cooldown interrupted by a second failure",
+      "0 load 30\n"
+      "0 util off\n"
+      "3h util on\n"
+      "3h14m util off\n"
+      "3h40m util on\n",
+      "power failed, generator start, connect to generator, power restored, "
+      "connect to utility, generator cooldown, power failed, generator start, "
+      "connect to generator, power restored, connect to utility, generator cooldown, "
+      "generator stop" },
+   {  "transfer switch stuck",
+      "0 switch stuck\n"
+      "0 util off\n"
+      "2h1m switch ok\n"
+      "3h util on\n",
+      "power failed, generator start, connect to generator, "
+      "couldn't connect to generator, generator start, connect to generator, "
+      "couldn't connect to generator, generator start, connect to generator, "
+      "couldn't connect to generator, generator start, connect to generator, "
+      "generator stop, power restored, connect to utility, generator cooldown, "
+      "generator stop" },
+   {  "at home toggled during an outage",
+      "0 util off\n"
+      "10m press athome\n"
+      "1h press athome\n"
+      "3h util on\n",
+      "power failed, generator start, connect to generator, generator stop, "
+      "power restored, connect to utility, generator cooldown, generator stop" },
+   {  "weak starter battery",
+      "0 batt 110\n"
+      "0 util off\n"
+      "1h util on\n",
+      "power failed, starter battery weak, power restored" },
+   #if WIFI // the web server's
+   {  "configuration changes from the web",
+      "0 web 403 PUT /config.json || {\"gen_run_mins\":45}\n"
+      "0 webhas the password is needed\n"
+      "0 web 400 PUT /config.json || {\"pwd\":\"" ACTION_PASSWORD "\",\"gen_run_mins\":45,\"gen_nap_mins\":5}\n"
+      "0 webhas unknown setting\n"
+      "0 web 400 PUT /config.json || {\"pwd\":\"" ACTION_PASSWORD "\",\"gen_run_mins\":1000}\n"
+      "0 webhas gen_run_mins must be\n"
+      "0 web 200 PUT /config.json || {\"pwd\":\"" ACTION_PASSWORD "\",\"gen_run_mins\":45,\"gen_rest_mins\":20}\n"
+      "0 webhas changes recorded\n"
+      "0 web 200 GET /config.json\n"
+      "0 webhas \"gen_run_mins\":45\n"
+      "0 webhas \"gen_rest_mins\":20\n",
+      "configuration updated" },
+   {  "images that the browser has aren't sent again",
+      "0 web 200 GET /favicon.ico\n"
+      "0 web 304 GET /favicon.ico | If-None-Match: $etag\n"
+      "0 web 200 GET /favicon.ico | If-None-Match: \"00000000\"\n"
+      "0 web 200 GET /buttonimage.jpg | If-None-Match: $etag\n" // (the icon's)
+      "0 web 304 GET /buttonimage.jpg | If-None-Match: $etag\n"
+      "0 web 304 GET /buttonimage.jpg | If-None-Match: *\n",
+      "" },
+   {  "paging through the log after it wraps around",
+      "0 log 300\n"
+      "0 web 200 GET /log.json?limit=2\n"
+      "0 webhas \"msg\":\"test 300\"\n"
+      "0 webhas \"msg\":\"test 299\"\n"
+      "0 webnot \"msg\":\"test 298\"\n"
+      "0 webhas \"more\":false\n"
+      "# the oldest entries, which are around number 160 to 180 depending on the build, and then\n"
+      "# the rest; one of the pages crosses the end of the logfile[] array\n"
+      "0 web 200 GET /log.json?since=0&limit=50\n"
+      "0 webhas \"lost\":\n"
+      "0 webhas \"msg\":\"test 200\"\n"
+      "0 webnot \"msg\":\"test 230\"\n"
+      "0 webhas \"more\":true\n"
+      "0 web 200 GET /log.json?since=$next&limit=50\n"
+      "0 webnot \"lost\":\n"
+      "0 webnot \"msg\":\"test 200\"\n"
+      "0 webhas \"msg\":\"test 240\"\n"
+      "0 webhas \"more\":true\n"
+      "0 web 200 GET /log.json?since=$next&limit=50\n"
+      "0 webnot \"msg\":\"test 240\"\n"
+      "0 webhas \"msg\":\"test 290\"\n"
+      "0 webhas \"msg\":\"test 300\"\n"
+      "0 webhas \"more\":false\n"
+      "0 web 200 GET /log.json?since=$next\n"
+      "0 webhas \"entries\":[]\n",
+      "" },
+   {  "the visitor table forgets who visited longest ago",
+      "# it holds 250\n"
+      "0 visit 10.2.0.1 250\n"
+      "0 visit 10.2.0.1\n"
+      "0 visit 10.3.0.1\n"
+      "0 visitor 10.2.0.1 2\n"
+      "0 visitor 10.2.0.2 gone\n"
+      "0 visitor 10.2.0.3 1\n"
+      "0 visitor 10.3.0.1 1\n"
+      "# many replacements, each of which closes the gap it leaves in the hash table\n"
+      "0 visit 10.4.0.1 1000\n"
+      "0 visitor 10.4.3.232 1\n"
+      "0 visitor 10.4.2.239 1\n"
+      "0 visitor 10.4.2.238 gone\n"
+      "0 visitor 10.2.0.1 gone\n",
+      "" }
+   #endif
+};
+#define NUM_TESTS (sizeof(sim_tests) / sizeof(sim_tests[0]))
+
+static char sim_replay_script[SIM_REPLAY_SIZE]; // what we were given to replay
+static int sim_replay_length = 0;
+static bool sim_replay_loading = false;  // are we reading it?
+static bool sim_virtual = false;  // does delay() advance the virtual clock even when not running?
+static int sim_flood_secs = 0;    // for how long the "flood" command was asked to run, if it was
+static const struct sim_scenario_t sim_replay = {"replay", sim_replay_script, NULL };
+
+static const struct { // the configurations to compare, in minutes
+   unsigned short gen_delay, gen_run, gen_rest, gen_cooldown, util_return; }
+sim_configs[] = {
+   {2 * 60, 30, 3 * 60, 5, 12 },  // the defaults
+   {1 * 60, 30, 2 * 60, 5, 12 },
+   {2 * 60, 60, 3 * 60, 5, 12 },
+   {4 * 60, 30, 4 * 60, 5, 12 },
+   {2 * 60, FOREVER, 0, 5, 12 } }; // run until the power returns
+#define NUM_CONFIGS (sizeof(sim_configs) / sizeof(sim_configs[0]))
+
+struct sim_stats_t { // what happened during a scenario
+   unsigned long long util_off_msecs, gen_msecs, unpowered_msecs;
+   int outages, gen_starts, switch_ops;
+   unsigned long eeprom_changes; }; // bytes
+
+static struct { // the state of running scenarios
+   bool requested, comparing, testing, replaying; // "run", "compare", "test", or "replay" was asked for
+   bool running;              // are we running scenarios in virtual time?
+   const struct sim_scenario_t *scenarios; // the scenarios or tests
+   unsigned num_scenarios;
+   unsigned scenario, config; // which ones we are doing
+   struct config_hdr_t saved_config; // the configuration before we started comparing
+   const char *script;        // the rest of the scenario script
+   bool have_line;            // is there a next line?
+   char line[MAXLINE];        // the next line
+   char *command;             // its command part
+   unsigned long long start_msecs, next_msecs; // when the scenario started, and the next line happens
+   unsigned long start_eeprom_changes; // eeprom_bytes_changed when the scenario started
+   unsigned long real_start_millis;  // the real time we started
+   struct sim_stats_t stats, totals; // for this scenario, and for all of them
+   const char *expected;      // the rest of the events the test expects
+   bool failed;               // has this test failed?
+   int passed, failures;      // how many tests passed and failed
+} sim_run;
+
+static unsigned long long sim_msecs = 0;   // the virtual clock, in msec from when we started
+static time_t sim_epoch = SIM_EPOCH;       // the date and time when sim_msecs was 0
+static unsigned long sim_real_millis = 0;  // the real millis() when the virtual clock was last synced
+static time_t sim_deadline_time = 0;       // the earliest announced deadline, or 0 if none
+
+void sim_update(void);
+bool sim_scan_time(char **pptr, unsigned long *psecs);
+void sim_check(bool ok, const char *msg);
+
+//-------------------------------------------------------
+//    simulated world routines
+//-------------------------------------------------------
+
+bool sim_powered(void) { // does the house have power?
+   return sim.gen_connected ? sim.gen_running : sim.util_power; }
+
+void sim_show(void) { // show the state of the simulated world
+   Serial.print("sim: "); Serial.print(format_datetime(sim_now(), true));
+   Serial.print(", util "); Serial.print(sim.util_power ? "on" : "off");
+   Serial.print(", gen "); Serial.print(sim.gen_running ? "on" : "off");
+   if (sim.gen_fails) Serial.print(" (will fail)");
+   Serial.print(", switch at "); Serial.print(sim.gen_connected ? "gen" : "util");
+   if (sim.switch_stuck) Serial.print(" (stuck)");
+   Serial.print(", relays run "); Serial.print(sim.run_relay);
+   Serial.print(" connect "); Serial.print(sim.connect_relay);
+   Serial.print(", load "); Serial.print(sim.load_amps);
+   Serial.print("A, batt "); Serial.print(sim.batt_tenths / 10); Serial.print('.');
+   Serial.print(sim.batt_tenths % 10); Serial.println('V');
+   showing_screen = false; }
+
+void sim_help(void) {
+   Serial.println("sim commands: util on|off, gen ok|fail|stall, switch ok|stuck, load <amps>, batt <tenths>");
+   Serial.println("              press <button>, show, run, compare, test, stop, bench [<count>], fuzz [<count>]");
+   Serial.println("              flood [<secs>], trace, replay, log <count>, web <status> <request>");
+   Serial.println("              webhas|webnot <text>, visit <addr> [<count>], visitor <addr> <count>|gone");
+   showing_screen = false; }
+
+void sim_print_line(const char *line, void *arg) {
+   Serial.println(line);
+   showing_screen = false; }
+
+#if WIFI
+bool sim_scan_ip(char **pptr, IPAddress *paddr) { // scan an IP address like 10.0.0.1
+   int num[4], nch;
+   if (sscanf(*pptr, "%d.%d.%d.%d%n", &num[0], &num[1], &num[2], &num[3], &nch) != 4) return false;
+   for (int ndx = 0; ndx < 4; ++ndx)
+      if (num[ndx] < 0 || num[ndx] > 255) return false;
+   *paddr = IPAddress(num[0], num[1], num[2], num[3]);
+   *pptr += nch;
+   skip_blanks(pptr);
+   return true; }
+#endif
+
+bool sim_command(char *line) { // execute one command that changes the simulated world
+   char *ptr = line;
+   int num;
+   char msg[MAXLINE];
+   if (scan_key(&ptr, "UTIL")) {
+      if (scan_key(&ptr, "ON")) {
+         if (!sim.util_power) sim.switch_change_millis = (unsigned long)sim_msecs;
+         sim.util_power = true; }
+      else if (scan_key(&ptr, "OFF")) {
+         if (sim.util_power) ++sim_run.stats.outages;
+         sim.util_power = false; }
+      else return false; }
+   else if (scan_key(&ptr, "GEN")) {
+      if (scan_key(&ptr, "OK")) sim.gen_fails = false;
+      else if (scan_key(&ptr, "FAIL")) sim.gen_fails = true;
+      else if (scan_key(&ptr, "STALL")) {
+         if (sim.gen_running) sim.switch_change_millis = (unsigned long)sim_msecs;
+         sim.gen_running = false;
+         sim.gen_fails = true; }
+      else return false; }
+   else if (scan_key(&ptr, "SWITCH")) {
+      if (scan_key(&ptr, "OK")) {
+         if (sim.switch_stuck) sim.switch_change_millis = (unsigned long)sim_msecs;
+         sim.switch_stuck = false; }
+      else if (scan_key(&ptr, "STUCK")) sim.switch_stuck = true;
+      else return false; }
+   else if (scan_key(&ptr, "LOAD") && scan_int(&ptr, &num, 0, 100)) sim.load_amps = num;
+   else if (scan_key(&ptr, "BATT") && scan_int(&ptr, &num, 0, 150)) sim.batt_tenths = num;
+   else if (scan_key(&ptr, "LOG") && scan_int(&ptr, &num, 1, 10000)) {
+      for (int entry = 1; entry <= num; ++entry) log_eventf(EV_MISC, "test %d", entry); }
+   else if (scan_key(&ptr, "PRESS")) {
+      byte button;
+      for (button = 0; button < NUM_BUTTONS; ++button)
+         if (scan_key(&ptr, sim_buttons[button].name)) break;
+      if (button >= NUM_BUTTONS) return false;
+      sim.button_pushed[button] = true;
+      sim.button_push_millis[button] = (unsigned long)sim_msecs; }
+   else if (scan_key(&ptr, "SHOW")) sim_show();
+   else if (scan_key(&ptr, "END")) ; // only marks the end time of a scenario
+   else if (*ptr == '#') ; // a comment
+   else if (scan_key(&ptr, "RUN")) {
+      sim_run.requested = true; sim_run.comparing = sim_run.testing = sim_run.replaying = false; }
+   else if (scan_key(&ptr, "COMPARE")) {
+      sim_run.requested = true; sim_run.comparing = true; sim_run.testing = sim_run.replaying = false; }
+   else if (scan_key(&ptr, "TEST")) {
+      sim_run.requested = true; sim_run.comparing = sim_run.replaying = false; sim_run.testing = true; }
+   else if (scan_key(&ptr, "TRACE")) trace_script(sim_print_line, NULL);
+   else if (scan_key(&ptr, "REPLAY")) {
+      sim_replay_length = 0;
+      sim_replay_loading = true; }
+   else if (scan_key(&ptr, "STOP")) sim_run.running = sim_run.requested = false;
+   #if WIFI
+   else if (scan_key(&ptr, "BENCH")) {
+      if (!scan_int(&ptr, &num, 1, 1000)) num = 10;
+      web_benchmark(num); }
+   else if (scan_key(&ptr, "FUZZ")) {
+      if (!scan_int(&ptr, &num, 1, 10000)) num = 100;
+      bool was_virtual = sim_virtual; // (it may be on already, during setup())
+      sim_virtual_time(true);
+      web_fuzz(num);
+      sim_virtual_time(was_virtual); }
+   else if (scan_key(&ptr, "FLOOD")) {
+      if (!scan_int(&ptr, &num, 1, 3600)) num = 10;
+      sim_flood_secs = num; } // (sim_loop() does it, since we may be inside process_web() now)
+   else if (scan_key(&ptr, "WEBHAS")) {
+      sprintf(msg, "the response doesn't have %.200s", ptr);
+      sim_check(web_test_response_has(ptr), msg); }
+   else if (scan_key(&ptr, "WEBNOT")) {
+      sprintf(msg, "the response has %.200s", ptr);
+      sim_check(!web_test_response_has(ptr), msg); }
+   else if (scan_key(&ptr, "WEB")) {
+      if (!scan_int(&ptr, &num, 100, 599)) return false;
+      int status = web_test_request(ptr);
+      sprintf(msg, "expected status %d, got %d, for %.200s", num, status, ptr);
+      sim_check(status == num, msg); }
+   else if (scan_key(&ptr, "VISITOR")) { // (before "visit", which it starts with)
+      IPAddress addr;
+      if (!sim_scan_ip(&ptr, &addr)) return false;
+      long count = web_test_visitor(addr);
+      if (scan_key(&ptr, "GONE")) num = -1;
+      else if (!scan_int(&ptr, &num, 0, INT_MAX)) return false;
+      sprintf(msg, "expected %d requests from visitor %d.%d.%d.%d, got %ld (-1 is gone)",
+              num, addr[0], addr[1], addr[2], addr[3], count);
+      sim_check(count == num, msg); }
+   else if (scan_key(&ptr, "VISIT")) {
+      IPAddress addr;
+      if (!sim_scan_ip(&ptr, &addr)) return false;
+      if (!scan_int(&ptr, &num, 1, 10000)) num = 1;
+      sim_check(web_test_visit(addr, num), "the visitor table is inconsistent"); }
+   #endif
+   else return false;
+   return true; }
+
+void sim_replay_line(char *line) { // add a line to the script we're going to replay
+   int length = strlen(line);
+   if (sim_replay_length + length + 2 > SIM_REPLAY_SIZE) {
+      Serial.println("replay script is too long");
+      showing_screen = false;
+      sim_replay_loading = false;
+      return; }
+   memcpy(sim_replay_script + sim_replay_length, line, length);
+   sim_replay_length += length;
+   sim_replay_script[sim_replay_length++] = '\n';
+   sim_replay_script[sim_replay_length] = 0;
+   char *ptr = line;
+   unsigned long secs;
+   skip_blanks(&ptr);
+   if (sim_scan_time(&ptr, &secs) && scan_key(&ptr, "END")) { // that's all of it: go
+      sim_replay_loading = false;
+      sim_run.requested = sim_run.replaying = true;
+      sim_run.comparing = sim_run.testing = false; } }
+
+void sim_serial_commands(void) { // process commands typed into the serial port
+   static char line[MAXLINE];
+   static int linelength = 0;
+   while (Serial.available() > 0) {
+      char ch = Serial.read();
+      if (ch == '\r' || ch == '\n') {
+         if (linelength > 0) {
+            line[linelength] = 0;
+            if (sim_replay_loading) sim_replay_line(line);
+            else if (!sim_command(line)) sim_help();
+            linelength = 0; } }
+      else if (linelength < MAXLINE - 1) line[linelength++] = ch; } }
+
+//-------------------------------------------------------
+//    scenario routines
+//-------------------------------------------------------
+
+bool sim_scan_time(char **pptr, unsigned long *psecs) { // scan a time like 2d3h30m10s, or 0
+   unsigned long secs = 0;
+   if (!isdigit(**pptr)) return false;
+   while (isdigit(**pptr)) {
+      unsigned long num = 0;
+      while (isdigit(**pptr)) num = num * 10 + *(*pptr)++ - '0';
+      switch (toupper(**pptr)) {
+         case 'D': num *= 24 * 60 * 60; break;
+         case 'H': num *= 60 * 60; break;
+         case 'M': num *= 60; break;
+         case 'S': break;
+         default: if (num != 0) return false; // only 0 doesn't need units
+            --*pptr; }
+      ++*pptr;
+      secs += num; }
+   *psecs = secs;
+   skip_blanks(pptr);
+   return true; }
+
+void sim_script_next(void) { // get the next line of the scenario script, and when it happens
+   sim_run.have_line = false;
+   while (*sim_run.script) {
+      int length = strcspn(sim_run.script, "\n");
+      int copylength = length < MAXLINE - 1 ? length : MAXLINE - 1;
+      memcpy(sim_run.line, sim_run.script, copylength);
+      sim_run.line[copylength] = 0;
+      sim_run.script += sim_run.script[length] ? length + 1 : length;
+      sim_run.command = sim_run.line;
+      skip_blanks(&sim_run.command);
+      if (*sim_run.command == 0 || *sim_run.command == '#') continue; // skip blank lines and comments
+      unsigned long secs;
+      if (!sim_scan_time(&sim_run.command, &secs)) {
+         Serial.print("bad time in scenario line: "); Serial.println(sim_run.line);
+         continue; }
+      sim_run.next_msecs = sim_run.start_msecs + secs * 1000ULL;
+      sim_run.have_line = true;
+      break; } }
+
+void sim_add_stats(struct sim_stats_t *total, struct sim_stats_t *stats) {
+   total->util_off_msecs += stats->util_off_msecs;
+   total->gen_msecs += stats->gen_msecs;
+   total->unpowered_msecs += stats->unpowered_msecs;
+   total->outages += stats->outages;
+   total->gen_starts += stats->gen_starts;
+   total->switch_ops += stats->switch_ops;
+   total->eeprom_changes += stats->eeprom_changes; }
+
+void sim_show_stats(const char *title, struct sim_stats_t *stats) {
+   char string[MAXLINE];
+   sprintf(string, "%s: %d outages for %.1f hr; generator ran %.1f hr with %d starts; "
+           "%d switch operations; unpowered %.1f hr; %lu EEPROM bytes changed",
+           title, stats->outages, stats->util_off_msecs / SIM_HOUR_MSEC,
+           stats->gen_msecs / SIM_HOUR_MSEC, stats->gen_starts,
+           stats->switch_ops, stats->unpowered_msecs / SIM_HOUR_MSEC, stats->eeprom_changes);
+   Serial.println(string);
+   showing_screen = false; }
+
+void sim_show_config(void) {
+   char string[MAXLINE];
+   sprintf(string, "configuration: gen delay %u, run %u, rest %u, cooldown %u, util return %u minutes",
+           config_hdr.gen_delay_mins, config_hdr.gen_run_mins, config_hdr.gen_rest_mins,
+           config_hdr.gen_cooldown_mins, config_hdr.util_return_mins);
+   Serial.println(string);
+   showing_screen = false; }
+
+void sim_use_config(unsigned config) {
+   config_hdr.gen_delay_mins = sim_configs[config].gen_delay;
+   config_hdr.gen_run_mins = sim_configs[config].gen_run;
+   config_hdr.gen_rest_mins = sim_configs[config].gen_rest;
+   config_hdr.gen_cooldown_mins = sim_configs[config].gen_cooldown;
+   config_hdr.util_return_mins = sim_configs[config].util_return; }
+
+void sim_start_scenario(void) {
+   memset(&sim_run.stats, 0, sizeof(sim_run.stats));
+   sim.gen_fails = sim.switch_stuck = false; // the world starts out normal
+   sim.load_amps = 10;
+   sim.batt_tenths = 126;
+   sim_run.start_msecs = sim_msecs;
+   sim_run.start_eeprom_changes = eeprom_bytes_changed;
+   sim_run.script = sim_run.scenarios[sim_run.scenario].script;
+   sim_run.expected = sim_run.scenarios[sim_run.scenario].events;
+   sim_run.failed = false;
+   if (sim_run.testing) sim_use_config(0); // (an earlier test may have changed it through the web server)
+   sim_script_next(); }
+
+//-------------------------------------------------------
+//    regression test routines
+//-------------------------------------------------------
+
+void sim_show_elapsed(void) { // show how far into the scenario we are
+   char string[30];
+   unsigned long secs = (unsigned long)((sim_msecs - sim_run.start_msecs) / 1000);
+   sprintf(string, " at %lu:%02lu:%02lu", secs / 3600, secs / 60 % 60, secs % 60);
+   Serial.print(string); }
+
+void sim_test_failed(const char *msg) {
+   Serial.print("test "); Serial.print(sim_run.scenarios[sim_run.scenario].name);
+   Serial.print(" failed"); sim_show_elapsed();
+   Serial.print(": "); Serial.println(msg);
+   showing_screen = false;
+   sim_run.failed = true; }
+
+void sim_check(bool ok, const char *msg) { // a check that a command makes
+   if (sim_run.running && sim_run.testing) {
+      if (!ok && !sim_run.failed) sim_test_failed(msg); }
+   else {
+      Serial.println(ok ? "ok" : msg);
+      showing_screen = false; } }
+
+void sim_event_failed(const char *got) { // an event didn't match
+   char msg[MAXLINE];
+   int length = strcspn(sim_run.expected, ",");
+   if (length) sprintf(msg, "expected \"%.*s\", got \"%s\"", length, sim_run.expected, got);
+   else sprintf(msg, "unexpected \"%s\"", got);
+   sim_test_failed(msg); }
+
+void sim_log_event(byte event_type) { // check a logged event against what the test expects
+   if (sim_run.running && sim_run.replaying) { // or just show it
+      Serial.print("  "); Serial.print(event_names[event_type]);
+      sim_show_elapsed(); Serial.println();
+      showing_screen = false; }
+   if (!sim_run.running || !sim_run.testing || sim_run.failed) return;
+   switch (event_type) { // ignore events that don't come from the control logic
+      case EV_STARTUP: case EV_WATCHDOG_RESET: case EV_BATTERY_READ: case EV_MISC:
+      case EV_WIFI_RESET: case EV_WIFI_CONNECTED: case EV_WIFI_NOCONNECT: case EV_WIFI_DISCONNECTED:
+      case EV_IFTTT_QUEUED: case EV_IFTTT_SENDING: case EV_IFTTT_SENT: case EV_IFTTT_FAILED:
+         return; }
+   int length = strcspn(sim_run.expected, ",");
+   if (length == 0 || (int)strlen(event_names[event_type]) != length
+         || strncmp(sim_run.expected, event_names[event_type], length) != 0)
+      sim_event_failed(event_names[event_type]);
+   else { // it matched; move on to the next one
+      sim_run.expected += length;
+      if (*sim_run.expected == ',') ++sim_run.expected;
+      while (*sim_run.expected == ' ') ++sim_run.expected; } }
+
+void sim_test_done(void) { // the test scenario is over
+   if (!sim_run.failed && *sim_run.expected) sim_event_failed("no more events");
+   if (sim_run.failed) ++sim_run.failures;
+   else {
+      ++sim_run.passed;
+      Serial.print("test "); Serial.print(sim_run.scenarios[sim_run.scenario].name);
+      Serial.println(" passed");
+      showing_screen = false; } }
+
+bool sim_settled(void) { // is everything back to normal?
+   return sim.util_power && !sim.run_relay && !sim.gen_running && !sim.gen_connected
+          && util_on.val && util_connected.val && !gen_on.val && !gen_connected.val; }
+
+void sim_loop(void) { // called at the top of the main loop, to start and finish scenarios
+   #if WIFI
+   if (sim_flood_secs > 0 && !sim_run.running) {
+      web_flood(sim_flood_secs);
+      sim_flood_secs = 0; }
+   #endif
+   if (!sim_run.running) {
+      if (sim_run.requested) { // start the first scenario
+         sim_run.requested = false;
+         sim_run.running = true;
+         sim_run.scenario = sim_run.config = 0;
+         sim_run.scenarios = sim_run.replaying ? &sim_replay : sim_run.testing ? sim_tests : sim_scenarios;
+         sim_run.num_scenarios = sim_run.replaying ? 1 : sim_run.testing ? NUM_TESTS : NUM_SCENARIOS;
+         sim_run.passed = sim_run.failures = 0;
+         memset(&sim_run.totals, 0, sizeof(sim_run.totals));
+         sim_run.saved_config = config_hdr;
+         if (sim_run.comparing || sim_run.testing) sim_use_config(0);
+         sim_show_config();
+         sim_run.real_start_millis = millis();
+         sim_start_scenario(); }
+      return; }
+   if (sim_run.have_line) return;
+   if (!sim_settled()) {
+      if (sim_msecs - sim_run.next_msecs < SIM_SETTLE_MSEC) return;
+      if (sim_run.testing && !sim_run.failed) sim_test_failed("not back to normal");
+      else {
+         Serial.print(sim_run.scenarios[sim_run.scenario].name);
+         Serial.println(": not back to normal"); } }
+   // this scenario is over
+   sim_run.stats.eeprom_changes = eeprom_bytes_changed - sim_run.start_eeprom_changes;
+   if (sim_run.testing) sim_test_done();
+   else sim_show_stats(sim_run.scenarios[sim_run.scenario].name, &sim_run.stats);
+   sim_add_stats(&sim_run.totals, &sim_run.stats);
+   if (++sim_run.scenario >= sim_run.num_scenarios) { // and so is this configuration
+      if (sim_run.testing) {
+         char string[MAXLINE];
+         sprintf(string, "%d tests passed, %d failed", sim_run.passed, sim_run.failures);
+         Serial.println(string); }
+      else sim_show_stats("all scenarios", &sim_run.totals);
+      memset(&sim_run.totals, 0, sizeof(sim_run.totals));
+      sim_run.scenario = 0;
+      if (!sim_run.comparing || ++sim_run.config >= NUM_CONFIGS) { // we're done
+         config_hdr = sim_run.saved_config;
+         if (sim_run.testing) update_config(); // (a test may have changed it in EEPROM)
+         sim_run.running = false;
+         sim_real_millis = millis(); // resume following real time
+         Serial.print("simulation took "); Serial.print((millis() - sim_run.real_start_millis) / 1000.0f);
+         Serial.println(" seconds");
+         showing_screen = false;
+         return; }
+      sim_use_config(sim_run.config);
+      sim_show_config(); }
+   sim_start_scenario(); }
+
+//-------------------------------------------------------
+//    virtual clock routines
+//-------------------------------------------------------
+
+unsigned long long sim_next_change(void) { // when the simulated world will next change by itself
+   unsigned long long next = ULLONG_MAX;
+   unsigned long timenow = (unsigned long)sim_msecs;
+   #define SIM_NEXT(since, duration) { \
+      unsigned long elapsed = timenow - (since); \
+      unsigned long long when = sim_msecs + (elapsed < (duration) ? (duration) - elapsed : 0); \
+      if (when < next) next = when; }
+   if (sim.run_relay && !sim.gen_running && !sim.gen_fails) SIM_NEXT(sim.gen_change_millis, SIM_GEN_START_MSEC);
+   if (!sim.run_relay && sim.gen_running) SIM_NEXT(sim.gen_change_millis, SIM_GEN_STOP_MSEC);
+   if (sim.connect_relay != sim.gen_connected && !sim.switch_stuck
+         && (sim.connect_relay ? sim.gen_running : sim.util_power))
+      SIM_NEXT(sim.switch_change_millis, SIM_SWITCH_MSEC);
+   if (sim_run.have_line && sim_run.next_msecs < next) next = sim_run.next_msecs;
+   return next; }
+
+bool sim_quiet(void) { // is nothing in the controller in the middle of changing?
+   for (byte button = 0; button < NUM_BUTTONS; ++button)
+      if (sim.button_pushed[button]) return false;
+   return !util_on.changing && !gen_on.changing && !util_connected.changing && !gen_connected.changing; }
+
+void sim_advance(unsigned long long msecs) { // move the virtual clock forward, keeping statistics
+   sim_update();
+   if (sim_run.running && msecs > sim_msecs) {
+      unsigned long long elapsed = msecs - sim_msecs;
+      if (!sim.util_power) sim_run.stats.util_off_msecs += elapsed;
+      if (sim.gen_running) sim_run.stats.gen_msecs += elapsed;
+      if (!sim_powered()) sim_run.stats.unpowered_msecs += elapsed; }
+   if (msecs > sim_msecs) sim_msecs = msecs; }
+
+void sim_clock(void) { // when not running scenarios, the virtual clock follows real time
+   unsigned long real_millis = millis();
+   if (!sim_run.running) sim_advance(sim_msecs + (real_millis - sim_real_millis));
+   sim_real_millis = real_millis; }
+
+unsigned long sim_millis(void) {
+   sim_clock();
+   return (unsigned long)sim_msecs; }
+
+time_t sim_now(void) {
+   sim_clock();
+   return sim_epoch + (time_t)(sim_msecs / 1000); }
+
+void sim_setTime(time_t t) {
+   sim_epoch = t - (time_t)(sim_msecs / 1000); }
+
+void sim_deadline(time_t when) { // the control logic is waiting until this time
+   if (when < NEVER && (sim_deadline_time == 0 || when < sim_deadline_time))
+      sim_deadline_time = when; }
+
+void sim_virtual_time(bool on) { // make delay() not wait in real time, even when not running
+   sim_virtual = on; }
+
+bool sim_busy(void) { // are scenarios, tests, or a flood running, or about to, or is a replay being read?
+   return sim_run.requested || sim_run.running || sim_replay_loading || sim_flood_secs > 0; }
+
+void sim_delay(unsigned long msec) {
+   if (!sim_run.running && !sim_virtual) {
+      delay(msec); // real time
+      sim_clock(); }
+   else {
+      unsigned long long target = sim_msecs + msec;
+      if (sim_deadline_time != 0 && sim_quiet()) { // skip ahead to whatever happens next
+         unsigned long long deadline = (unsigned long long)(sim_deadline_time - sim_epoch) * 1000;
+         unsigned long long next = sim_next_change();
+         if (next < deadline) deadline = next;
+         if (deadline > target) target = deadline; }
+      sim_advance(target); }
+   sim_deadline_time = 0;
+   sim_update(); }
+
+//-------------------------------------------------------
+//    simulated hardware routines
+//-------------------------------------------------------
+
+void sim_update(void) { // bring the simulated world up to the current virtual time
+   static bool updating = false; // anti-recursion flag
+   if (updating) return;
+   updating = true;
+   unsigned long timenow = (unsigned long)sim_msecs;
+   // the generator starts or stops a while after the run relay changes
+   if (sim.run_relay && !sim.gen_running && !sim.gen_fails
+         && timenow - sim.gen_change_millis >= SIM_GEN_START_MSEC) {
+      sim.gen_running = true;
+      sim.switch_change_millis = timenow; }
+   if (!sim.run_relay && sim.gen_running
+         && timenow - sim.gen_change_millis >= SIM_GEN_STOP_MSEC) {
+      sim.gen_running = false;
+      sim.switch_change_millis = timenow; }
+   // the switch moves to the source the relay asks for, but only if that source has power
+   if (sim.connect_relay != sim.gen_connected && !sim.switch_stuck
+         && (sim.connect_relay ? sim.gen_running : sim.util_power)
+         && timenow - sim.switch_change_millis >= SIM_SWITCH_MSEC) {
+      sim.gen_connected = sim.connect_relay;
+      ++sim_run.stats.switch_ops; }
+   for (byte button = 0; button < NUM_BUTTONS; ++button) // release simulated buttons
+      if (sim.button_pushed[button] && timenow - sim.button_push_millis[button] >= SIM_PRESS_MSEC)
+         sim.button_pushed[button] = false;
+   while (sim_run.running && sim_run.have_line && sim_msecs >= sim_run.next_msecs) {
+      if (!sim_command(sim_run.command)) {
+         Serial.print("bad scenario command: "); Serial.println(sim_run.command);
+         showing_screen = false; }
+      sim_script_next(); }
+   sim_serial_commands();
+   updating = false; }
+
+void sim_tick(void) { // time passes as the controller reads its inputs
+   if (sim_run.running) sim_advance(sim_msecs + SIM_READ_MSEC);
+   else sim_clock();
+   sim_update(); }
+
+uint8_t sim_digitalRead(uint8_t pin) {
+   sim_tick();
+   switch (pin) { // the status inputs are low when true
+      case UTIL_ON_PIN: return sim.util_power ? LOW : HIGH;
+      case GEN_ON_PIN: return sim.gen_running ? LOW : HIGH;
+      case GEN_CONNECTED_PIN: return sim.gen_connected ? LOW : HIGH;
+      case UTIL_CONNECTED_PIN: return sim.gen_connected ? HIGH : LOW; }
+   for (byte button = 0; button < NUM_BUTTONS; ++button)
+      if (pin == sim_buttons[button].pin && sim.button_pushed[button]) return LOW;
+   return digitalRead(pin); } // the real buttons work too
+
+void sim_digitalWrite(uint8_t pin, uint8_t val) {
+   sim_update();
+   if (pin == RUN_GEN_RELAY) {
+      if ((val == RELAY_ON) != sim.run_relay) {
+         sim.run_relay = val == RELAY_ON;
+         if (sim.run_relay) ++sim_run.stats.gen_starts;
+         sim.gen_change_millis = (unsigned long)sim_msecs; } }
+   else if (pin == CONNECT_GEN_RELAY) {
+      if ((val == RELAY_ON) != sim.connect_relay) {
+         sim.connect_relay = val == RELAY_ON;
+         sim.switch_change_millis = (unsigned long)sim_msecs; } }
+   else digitalWrite(pin, val); } // LEDs, WiFi reset, and display power are real
+
+int sim_analog_value(float value, float example_value, float example_analogV) {
+   // the inverse of analog() in the main module
+   int raw = (int)(value / example_value * example_analogV / ANALOG_REF * 1024);
+   return raw < 0 ? 0 : raw > 1023 ? 1023 : raw; }
+
+int sim_analogRead(uint8_t pin) {
+   sim_update();
+   switch (pin) {
+      case UTIL_VOLTAGE:
+         return sim_analog_value(sim.util_power ? SIM_VOLTS : 0, VOLTAGE_EXAMPLE, VOLTAGE_ANALOG);
+      case GEN_VOLTAGE:
+         return sim_analog_value(sim.gen_running ? SIM_VOLTS : 0, VOLTAGE_EXAMPLE, VOLTAGE_ANALOG);
+      case LOAD_CURRENT1:
+      case LOAD_CURRENT2:
+         return sim_analog_value(sim_powered() ? sim.load_amps : 0, CURRENT_EXAMPLE, CURRENT_ANALOG);
+      case BATT_VOLTAGE:
+         return sim_analog_value(sim.batt_tenths / 10.0f - BATT_VOLTAGE_ADJ, BATT_EXAMPLE, BATT_ANALOG); }
+   return 0; }
+
+static byte sim_eeprom_data[E2END + 1]; // starts out blank, so the config gets initialized
+struct sim_eeprom_t sim_EEPROM;
+
+uint8_t sim_eeprom_t::read(int addr) {
+   return addr >= 0 && addr <= E2END ? sim_eeprom_data[addr] : 0; }
+
+void sim_eeprom_t::write(int addr, uint8_t val) {
+   if (addr >= 0 && addr <= E2END) sim_eeprom_data[addr] = val; }
+
+void sim_setup(void) {
+   sim_real_millis = millis();
+   Serial.println("Simulating the generator, transfer switch, and EEPROM");
+   sim_help();
+   sim_show(); }
+
+#endif // SIMULATE
+//*
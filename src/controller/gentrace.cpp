@@ -0,0 +1,210 @@
+// file: gentrace.cpp
+/* ----------------------------------------------------------------------------------------
+   input trace routines
+
+   When compiled with TRACE true, we record the changes of the inputs that drive the
+   control logic in a ring buffer in RAM, so that when something goes wrong at a site
+   we know more than the event log can tell us. We record:
+     - the debounced changes of the four status pins: utility on, generator on,
+       connected to utility, and connected to generator
+     - button pushes, whether from the real buttons or from the web page
+     - the analog load current, battery voltage, and utility and generator voltage,
+       but only when they have changed by a noticeable amount, and not too often
+     - when the controller started
+
+   The /trace.txt web page returns the trace as a scenario script for the simulator
+   (see gensimulate.cpp), with times relative to the oldest change we still have.
+   The inputs the simulator can reproduce become commands: "util on|off", "press <button>",
+   "load <amps>", and "batt <tenths>". The ones that the simulated generator and transfer
+   switch produce on their own become comments, like "# gen on", for comparison.
+   Paste it after the "replay" command of a controller compiled with SIMULATE true, and
+   the field incident is rerun on the virtual clock, with the logged events shown.
+
+   See the main module for other details and the change log.
+   ----------------------------------------------------------------------------------------
+   Copyright (c) 2019,2020 Len Shustek
+   The MIT License (MIT)
+   Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+   and associated documentation files (the "Software"), to deal in the Software without
+   restriction, including without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in all copies or
+   substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+   BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+   DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+   ------------------------------------------------------------------------------------------------*/
+
+#include "generator.h"
+
+#if TRACE
+
+#define TRACE_ENTRIES 1024        // how many input changes we keep, at 8 bytes each
+#define TRACE_ANALOG_MSEC 10000   // record an analog input at most this often,
+#define TRACE_ANALOG_CHANGE 10    //   and only if it changed by this many counts out of 1024
+
+enum trace_type_t {TR_STARTUP, TR_PIN, TR_BUTTON, TR_ANALOG };
+
+struct trace_entry_t {
+   time_t datetime;         // when it happened
+   byte type;               // trace_type_t
+   byte id;                 // which pin or button
+   unsigned short value; }; // the pin's new value, the raw analog reading, or the status pins at startup
+
+static struct trace_entry_t trace[TRACE_ENTRIES]; // a ring of the most recent
+unsigned long trace_count = 0; // how many were ever recorded
+
+static const char *trace_button_names[NUM_BUTTONS] = { // in the same order as button_pins[]
+   "gen", "menu", "left", "right", "up", "down", "athome" };
+
+static const struct { // the status pins, in the order of their bits in a startup entry
+   byte pin;
+   const char *text[2]; } // what we say when they go off and on
+trace_status[] = {
+   {UTIL_ON_PIN, {"util off", "util on" } },
+   {GEN_ON_PIN, {"# gen off", "# gen on" } },
+   {UTIL_CONNECTED_PIN, {"# util disconnected", "# util connected" } },
+   {GEN_CONNECTED_PIN, {"# gen disconnected", "# gen connected" } } };
+#define TRACE_STATUS_PINS (sizeof(trace_status) / sizeof(trace_status[0]))
+
+static const byte trace_analog_pins[] = {LOAD_CURRENT1, LOAD_CURRENT2, BATT_VOLTAGE, UTIL_VOLTAGE, GEN_VOLTAGE };
+#define TRACE_ANALOG_INPUTS (sizeof(trace_analog_pins) / sizeof(trace_analog_pins[0]))
+
+//-------------------------------------------------------
+//    recording routines
+//-------------------------------------------------------
+
+static void trace_add(byte type, byte id, unsigned short value) {
+   struct trace_entry_t *pt = &trace[trace_count++ % TRACE_ENTRIES];
+   pt->datetime = now();
+   pt->type = type;
+   pt->id = id;
+   pt->value = value; }
+
+void trace_startup(unsigned short status_pins) { // we started, with the status pins in these bits
+   trace_add(TR_STARTUP, 0, status_pins); }
+
+void trace_pin(byte pin, bool val) { // a status pin changed
+   trace_add(TR_PIN, pin, val); }
+
+void trace_button(byte button) { // a button was pushed
+   trace_add(TR_BUTTON, button, 0); }
+
+void trace_analog(byte pin, unsigned raw) { // an analog input was read
+   static struct {
+      unsigned short raw;
+      unsigned long millis;
+      bool recorded; }
+   last[TRACE_ANALOG_INPUTS];
+   for (unsigned input = 0; input < TRACE_ANALOG_INPUTS; ++input)
+      if (trace_analog_pins[input] == pin) {
+         int change = (int)raw - last[input].raw;
+         if (!last[input].recorded
+               || ((change >= TRACE_ANALOG_CHANGE || change <= -TRACE_ANALOG_CHANGE)
+                   && millis() - last[input].millis >= TRACE_ANALOG_MSEC)) {
+            trace_add(TR_ANALOG, pin, raw);
+            last[input].raw = raw;
+            last[input].millis = millis();
+            last[input].recorded = true; }
+         return; } }
+
+//-------------------------------------------------------
+//    routines to write the trace as a simulator script
+//-------------------------------------------------------
+
+static float trace_analog_value(unsigned raw, float example_value, float example_analogV) {
+   // the same conversion as analog() in the main module
+   return (float)raw * ANALOG_REF / 1024 * example_value / example_analogV; }
+
+static char *trace_format_time(unsigned long secs) { // like 2d3h30m10s, or 0
+   static char string[20];
+   int length = 0;
+   if (secs == 0) return strcpy(string, "0");
+   if (secs >= 24 * 60 * 60) length += sprintf(string + length, "%lud", secs / (24 * 60 * 60));
+   if (secs / (60 * 60) % 24) length += sprintf(string + length, "%luh", secs / (60 * 60) % 24);
+   if (secs / 60 % 60) length += sprintf(string + length, "%lum", secs / 60 % 60);
+   if (secs % 60) sprintf(string + length, "%lus", secs % 60);
+   return string; }
+
+void trace_script(void (*output)(const char *line, void *arg), void *arg) {
+   // produce the trace as a scenario script, one line at a time
+   char line[MAXLINE];
+   unsigned long num = trace_count < TRACE_ENTRIES ? trace_count : TRACE_ENTRIES;
+   if (num == 0) {
+      output("# the trace is empty", arg);
+      return; }
+   unsigned long first = trace_count - num;
+   time_t start = trace[first % TRACE_ENTRIES].datetime;
+   sprintf(line, "# %lu input changes starting at %s", num, format_datetime(start, true));
+   output(line, arg);
+   sprintf(line, "# downloaded at %s", format_datetime(now(), true));
+   output(line, arg);
+   bool status[TRACE_STATUS_PINS] = {true, false, true, false }; // what we assume at the start,
+   for (unsigned long ndx = first; ndx < trace_count; ++ndx) { // but if utility first comes on, it was off
+      struct trace_entry_t *pt = &trace[ndx % TRACE_ENTRIES];
+      if (pt->type == TR_STARTUP) break;
+      if (pt->type == TR_PIN && pt->id == UTIL_ON_PIN) {
+         if (pt->value) {
+            output("0 util off", arg);
+            status[0] = false; }
+         break; } }
+   int phase1 = 0, phase2 = 0, load = -1, batt = -1;
+   struct trace_entry_t *pt = NULL;
+   for (unsigned long ndx = first; ndx < trace_count; ++ndx) {
+      pt = &trace[ndx % TRACE_ENTRIES];
+      int length = sprintf(line, "%s ", trace_format_time(pt->datetime - start));
+      char *text = line + length;
+      if (pt->type == TR_STARTUP) {
+         strcpy(text, "# controller started");
+         output(line, arg);
+         for (unsigned pin = 0; pin < TRACE_STATUS_PINS; ++pin) { // the pins may not be what we thought
+            bool val = (pt->value >> pin) & 1;
+            if (val != status[pin]) {
+               status[pin] = val;
+               strcpy(text, trace_status[pin].text[val]);
+               output(line, arg); } }
+         continue; }
+      else if (pt->type == TR_BUTTON) sprintf(text, "press %s", trace_button_names[pt->id]);
+      else if (pt->type == TR_PIN) {
+         unsigned pin;
+         for (pin = 0; pin < TRACE_STATUS_PINS; ++pin)
+            if (trace_status[pin].pin == pt->id) break;
+         if (pin >= TRACE_STATUS_PINS || status[pin] == pt->value) continue; // (after startup, it isn't a change)
+         status[pin] = pt->value;
+         strcpy(text, trace_status[pin].text[pt->value]); }
+      else if (pt->type == TR_ANALOG) {
+         switch (pt->id) {
+            case LOAD_CURRENT1:
+            case LOAD_CURRENT2: { // the simulator has one load for both phases, when there's power
+                  int amps = (int)(trace_analog_value(pt->value, CURRENT_EXAMPLE, CURRENT_ANALOG) + 0.5f);
+                  if (pt->id == LOAD_CURRENT1) phase1 = amps; else phase2 = amps;
+                  int maxamps = phase1 > phase2 ? phase1 : phase2;
+                  bool powered = (status[0] && status[2]) || (status[1] && status[3]);
+                  // (no current is because the power just went off, before the status pins say so)
+                  if (!powered || maxamps == 0 || maxamps == load) continue;
+                  load = maxamps;
+                  sprintf(text, "load %d", load); }
+               break;
+            case BATT_VOLTAGE: {
+                  int tenths = (int)((trace_analog_value(pt->value, BATT_EXAMPLE, BATT_ANALOG) + BATT_VOLTAGE_ADJ) * 10 + 0.5f);
+                  if (tenths == batt) continue;
+                  batt = tenths;
+                  sprintf(text, "batt %d", batt); }
+               break;
+            default: // the utility and generator voltages
+               sprintf(text, "# %s %d VAC", pt->id == UTIL_VOLTAGE ? "util" : "gen",
+                       (int)(trace_analog_value(pt->value, VOLTAGE_EXAMPLE, VOLTAGE_ANALOG) + 0.5f)); } }
+      output(line, arg); }
+   sprintf(line, "%s end", trace_format_time(pt->datetime - start));
+   output(line, arg); }
+
+#else
+void trace_script(void (*output)(const char *line, void *arg), void *arg) {
+   output("# tracing is not compiled in; set TRACE in generator.h", arg); }
+#endif //TRACE
+//*
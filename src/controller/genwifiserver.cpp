@@ -6,16 +6,66 @@
    (Unfortunately some WiFiNINA calls block for many seconds!)
 
    As a web server we provide the current status page as the home page. There are also these subpages:
-     /log         show the event log
+     /log         show the event log, newest first, with each entry's number, message, and extra info.
+                  "?limit=N" shows only the newest N; "?since=S&limit=N" shows the first N after number S.
+     /log.json    return the same entries as JSON, oldest first, with "next" as the "since" to use to
+                  get newer ones, so a program can collect the log by fetching only what's new
+     /log.csv     return the same entries as comma-separated values, oldest first
+     /log.bin     return the same entries as their raw bytes, with the configuration, the WiFi
+                  and IFTTT counters, and the event names, for the logdecode program to make into
+                  a dataset with the logs from other sites; see the format below
      /visitors    show the list of IP addresses who visited
+     /stats       show how many of each kind of response we generated, and what they took,
+                  what it took to read the requests and how many we rejected,
+                  how long the main loop takes, with any long stalls,
+                  and how much RAM the stack has used
+     /profile     show the CPU cycles taken by the profiled zones of code, if PROFILE is on
+     /trace.txt   return the recent input changes as a script for the simulator, if TRACE is on
+     /status.json return the status as JSON, for monitoring programs: the status pins, relays,
+                  voltages, currents, battery, exercise, and what we're waiting for and how long
+     /metrics     return the counters and readings in the Prometheus text format, for a
+                  Prometheus server to scrape
+     /config      show a form to change the configuration: the generator and utility times and
+                  the exercise schedule, as on the front panel; it posts to /config.html
+     /config.json return the configuration as JSON; a PUT of some or all of the same object,
+                  with the password as "pwd", changes it
+     /events      keep the connection open and send Server-Sent Events as things change:
+                  "lcd" with a display row that changed, and "status" with the status pins,
+                  relays, and "at home" when any of them change. Several clients can watch.
+     /favicon.ico, /buttonimage.jpg
+                  the images, with an ETag and a hash in the URL so browsers can cache them
      /pushbutton  push the button in the POST request "button=x"
                   and return the status page after a delay
                   that allows the button action to happen
 
-   Only one client is supported at a time, and the WiFiNINA library has several bugs:
+   Several clients are served at once, each in its own slot of a connection table that
+   reads the request a piece at a time as it arrives, then responds. A slot waiting to send
+   the status page after a button push, or watching /events, doesn't hold up the others.
+   When all the slots are busy a new client is told to try again later.
+
+   A connection stays open after a response (HTTP/1.1 "keep-alive"), for a few seconds and a
+   limited number of requests, so a browser can get the page and its images without setting
+   up a new connection through the WiFi module each time. Requests sent without waiting for
+   the previous response are answered in order. A response that we can't give a length
+   because it didn't fit in the send buffer closes the connection, as does a response to a
+   client that asked for that. An idle connection is closed if its slot is needed.
+
+   The web is served from idle(), while the control logic waits, so a client or scanner that
+   sends requests as fast as it can mustn't slow down the control loop. Each call of
+   process_web() makes at most one full response, with the slots taking turns, and each
+   client (by IP address) and all of them together have a token bucket of requests we'll
+   answer: a burst of a few, then one every so often. A client's bucket is kept with its
+   entry in the visitor table, clients[]. A request beyond that gets a short "429 Too Many
+   Requests" as soon as it arrives, on a new connection or a kept one, before any of it is
+   read, and the connection is closed. A client who gave the password is only held to its
+   own limit, so a flood from many addresses doesn't lock out the people who run the
+   generator. The "flood" command of the simulator measures what a flood of requests does to
+   the control loop.
+
+   The WiFiNINA library has some problems:
      - long transfers (ie images) have to be broken up and separated in time
-     - it won't accept two simultaneous connections from the client, which the Chrome
-       brower does for images
+     - the module has only 10 sockets, one of which is listening for clients and one of
+       which we keep for IFTTT triggers, so that's the most slots we can have
 
    Also, the wifi module can get itself into a state where even a reset won't get it working.
    It that case we drop and restore its power to try to get it running again.
@@ -62,65 +112,285 @@
 
 #if WIFI
 
-#define MAX_IP_ADDRESSES 50     // maximum visitors we keep track of
+#define MAX_IP_ADDRESSES 250    // maximum visitors we keep track of,
+#define IP_HASH_BITS 9          //   in a hash table of 2^9 = 512 slots, which should be at least 1.5 times as many
+#define IP_HASH_SIZE (1 << IP_HASH_BITS)
 #define DELAYED_RSP_MSEC 1000   // how long to delay an HTTP response for a button push to be processed
+#define CLIENT_BUFFER_SIZE 4096 // what we send is collected in a buffer this big, which holds most pages,
+#define CHUNK_MAX 500           //   then sent to the WiFi module in chunks of at most this, to get around WiFiNINA bugs,
+#define CHUNK_MIN 200           //   or as small as this if it's having trouble,
+#define CHUNK_DELAY_MIN 10      //   with at least this many msec between them, which it also needs,
+#define CHUNK_DELAY_MAX 100     //   and as many as this if it's having trouble
+#define CHUNK_REFUSALS 10       // how many times in a row a chunk can be refused before we give up
+#define EVENTS_MSEC 250         // how often to look for changes to send to the /events client,
+#define EVENTS_KEEPALIVE_MSEC 15000 //   and how long to go without sending it something
+#define MAX_REQUEST_LINES 50    // the most lines we read from a request, including a POST body,
+#define MAX_REQUEST_BYTES 8192  //   the most bytes,
+#define MAX_REQUEST_MSEC 5000   //   and the longest we wait for all of it, before we give up on it
+#define REQUEST_IDLE_MSEC 1000  // how long we wait for more of a line before taking what we have
+#define MAX_CONNECTIONS 6       // how many clients we serve at once (see above)
+#define KEEPALIVE_MSEC 5000     // how long a connection may wait, idle, for another request,
+#define KEEPALIVE_REQUESTS 20   //   and the most requests we serve on one connection
+#define HEADER_END_RESERVE 64   // room kept in the buffer for the end of an HTTP header we left open
+#define NO_BODY -2              // the "content length" of a response that has no body
+#define CLIENT_BURST 12         // the most requests one client may make at once,
+#define CLIENT_REQUEST_MSEC 250 //   and then one this often; more are refused with a quick 429
+#define WEB_BURST 10            // the same for all the clients together,
+#define WEB_REQUEST_MSEC 200    //   which is 5 a second, fewer than we can make, or it would never limit them
+#define RESPONSES_PER_TURN 1    // how many full responses we make each time process_web() is called
 
 WiFiServer server(WIFI_PORT); // 80 is standard; others are more secure
-WiFiClient client; // static client allows only one at a time when we're a server
+WiFiClient client; // the client we use to send IFTTT triggers
 
 IPAddress remote_IP;
-enum {WEB_NOT_CONNECTED, WEB_AWAITING_CONNECTION,   // WiFi network connection states
+enum web_status_t {WEB_NOT_CONNECTED, WEB_AWAITING_CONNECTION,   // WiFi network connection states
       WEB_AWAITING_CLIENT, WEB_PROCESSING_REQUEST   // web server states
      } web_status = WEB_NOT_CONNECTED;
+const char *web_status_names[] = {"not connected", "awaiting connection", "awaiting client", "processing request" };
 
-enum  request_type_t {REQ_UNKNOWN, REQ_ROOT, REQ_VISITORS, REQ_LOG, REQ_PUSHBUTTON, REQ_SETPASS, REQ_FAVICON, REQ_BUTTONIMAGE };
-const char *request_type_names[] = {"unknown", "root", "visitors", "log", "pushbutton", "setpass", "favicon", "buttonimage", "???" };
+byte web_state(void) {
+   return web_status; }
 
-enum response_type_t {RSP_UNKNOWN, RSP_STATUS, RSP_VISITORS, RSP_LOG, RSP_FAVICON, RSP_BUTTONIMAGE, RSP_ASKPASS, RSP_NONE };
-const char *response_type_names[] = {"unknown", "status", "visitors", "log", "favicon", "buttonimage", "askpass", "no_response", "???" };
+enum  request_type_t {REQ_UNKNOWN, REQ_ROOT, REQ_VISITORS, REQ_LOG, REQ_PUSHBUTTON, REQ_SETPASS, REQ_FAVICON, REQ_BUTTONIMAGE, REQ_STATS, REQ_PROFILE, REQ_TRACE, REQ_JSON, REQ_EVENTS, REQ_LOGJSON, REQ_LOGCSV, REQ_LOGBIN, REQ_METRICS, REQ_CONFIG, REQ_SETCONFIG, REQ_CONFIGJSON, REQ_PUTCONFIG };
+const char *request_type_names[] = {"unknown", "root", "visitors", "log", "pushbutton", "setpass", "favicon", "buttonimage", "stats", "profile", "trace", "json", "events", "logjson", "logcsv", "logbin", "metrics", "config", "setconfig", "configjson", "putconfig", "???" };
 
-bool delayed_response = false;
-unsigned long delayed_sendtime;
+enum response_type_t {RSP_UNKNOWN, RSP_STATUS, RSP_VISITORS, RSP_LOG, RSP_FAVICON, RSP_BUTTONIMAGE, RSP_STATS, RSP_PROFILE, RSP_TRACE, RSP_NOTMODIFIED, RSP_JSON, RSP_LOGJSON, RSP_LOGCSV, RSP_LOGBIN, RSP_METRICS, RSP_CONFIG, RSP_CONFIGJSON, RSP_ASKPASS, RSP_NONE };
+const char *response_type_names[] = {"unknown", "status", "visitors", "log", "favicon", "buttonimage", "stats", "profile", "trace", "notmodified", "json", "logjson", "logcsv", "logbin", "metrics", "config", "configjson", "askpass", "no_response", "???" };
 
 time_t next_connect_time = 0;  // when to next try to connect to the WiFi network
 
+struct bucket_t { // a token bucket, to limit how often requests are answered
+   unsigned short tokens;       // how many more we may answer now,
+   unsigned long refill_millis; //   and when it last got one, or was full
+};
+
 struct client_t { // history of the clients whose web browsers made requests
    IPAddress ip_address;
    long count;
    time_t first_time, recent_time;
-   bool gave_password; }
-clients[MAX_IP_ADDRESSES],
-        *current_client;
+   bool gave_password;
+   struct bucket_t bucket; // for limiting their requests
+   short newer, older; } // our neighbors in the list by recent visit, or -1
+clients[MAX_IP_ADDRESSES];
+short num_clients = 0; // how many of those are in use
+short newest_client = -1, oldest_client = -1; // the ends of the list by recent visit
+unsigned short client_hash[IP_HASH_SIZE]; // 1 + the index in clients[] of an IP address, or 0 if empty
 long requests_processed = 0;
 long wifi_connects = 0, wifi_connectfails = 0, wifi_disconnects = 0, wifi_resets = 0;
 long ifttt_queues = 0, ifttt_sends = 0, ifttt_successes = 0, ifttt_failures = 0;
 
-char linebuf[MAXLINE];
+struct rsp_stats_t { // what it took to generate each type of response
+   long responses, writes, bytes;
+   unsigned long msecs, max_msecs; }
+rsp_stats[RSP_NONE],
+          *rsp_counting = NULL; // the one being generated now, if any
 
-bool client_write(WiFiClient *pclient, const char *buf, int length, bool show) {
-#define CHUNKSIZE 500 // to get around WiFiNINA bugs...
+/* The configuration that /config can change, which is what do_configuration() changes from the
+   front panel except the time, with the same limits. A change is all or nothing: the values
+   are collected as the request is read, and only if they are all good, and the password was
+   given with them, are they put in config_hdr together and written to EEPROM once. The controller
+   uses each new value the next time it needs it. */
+
+static const struct config_field_t { // a configuration value we can change
+   const char *name;
+   byte offset, size;                // where it is in config_hdr
+   unsigned short min, max;
+   bool forever; }                   // can it also be FOREVER?
+config_fields[] = {
+#define CONFIG_FIELD(field, min, max, forever) {#field, offsetof(struct config_hdr_t, field), sizeof(config_hdr.field), min, max, forever }
+   CONFIG_FIELD(gen_delay_mins, 0, 999, false),
+   CONFIG_FIELD(gen_run_mins, 0, 999, true),
+   CONFIG_FIELD(gen_rest_mins, 0, 999, false),
+   CONFIG_FIELD(gen_cooldown_mins, 0, 999, false),
+   CONFIG_FIELD(util_return_mins, 0, 999, false),
+   CONFIG_FIELD(exer_duration_mins, 0, 99, false),
+   CONFIG_FIELD(exer_wday, 1, 7, false),
+   CONFIG_FIELD(exer_hour, 0, 23, false),
+   CONFIG_FIELD(exer_weeks, 1, 9, false)
+#undef CONFIG_FIELD
+};
+#define NUM_CONFIG_FIELDS (sizeof(config_fields) / sizeof(config_fields[0]))
+
+enum line_part_t {LINE_KEY, LINE_VALUE, LINE_SKIP };
+
+struct web_request_t { // what a client asked for
+   enum request_type_t type;
+   int button;          // for REQ_PUSHBUTTON, the button pushed, or -1
+   bool got_body;       // for REQ_SETPASS, was there a body,
+   bool password_ok;    //   and did it (or a configuration change) have the right password?
+   unsigned short config_values[NUM_CONFIG_FIELDS]; // for REQ_SETCONFIG and REQ_PUTCONFIG, the new values,
+   unsigned short config_given; //   a bit for each one we were given,
+   signed char config_bad;      //   and which was wrong: its index, NUM_CONFIG_FIELDS if we didn't know it, or -1
+   bool have_image;     // for REQ_FAVICON and REQ_BUTTONIMAGE, does the browser already have it?
+   bool rejected;       // did it have too many lines or bytes, or take too long?
+   bool keep_alive;     // may the connection stay open afterwards?
+   long log_since;      // for REQ_LOG and the other log requests, the "since" entry number, or -1,
+   int log_limit;       //   and the "limit", or 0
+   int lines;           // how many lines we read
+   unsigned long bytes; //   and bytes
+   bool in_body;        // are we reading the POST body yet?
+   long content_length; //   which is this long, or -1 if we weren't told,
+   long body_bytes;     //   and how much of it we've read
+   char line[MAXLINE];  // the line we're reading,
+   int line_length;     //   how much of it we have,
+   bool line_truncated; //   and whether some of it had to be discarded
+   byte line_part;      // are we in the line's key (the method and path, or a header's name), after it, or skipping it?
+   uint32_t key_hash;   //   the hash of the key so far,
+   int key_length;      //   how long it was,
+   byte key_spaces;     //   and how many blanks we've seen in it
+   unsigned long start_millis, idle_start_millis; };
+
+struct parse_stats_t { // what it took to read the requests
+   long requests, lines, bytes;
+   long long_lines, too_many_lines, too_many_bytes, too_slow;
+   unsigned long max_bytes, max_msecs; }
+parse_stats;
+
+enum conn_state_t {CONN_FREE, CONN_READING, CONN_DELAYED, CONN_EVENTS, CONN_IDLE };
+
+struct connection_t { // a client we're serving
+   enum conn_state_t state;
+   WiFiClient client;
+   WiFiClient *pclient;               // &client, or a made-up client (see web_flood())
+   int requests;                      // how many requests we've answered on this connection
+   struct web_request_t request;      // for CONN_READING, the request so far
+   unsigned long delayed_millis;      // for CONN_DELAYED, when we pushed the button
+   unsigned long idle_millis;         // for CONN_IDLE, when we finished the last response
+   char events_lcdbuf[4][21];         // for CONN_EVENTS, the display rows we sent,
+   byte events_status;                //   the status bits we sent,
+   unsigned long events_check_millis, events_sent_millis; } // and when we last looked and sent
+connections[MAX_CONNECTIONS];
+long connections_accepted = 0, connections_refused = 0;
+long connections_reused = 0, connections_reclaimed = 0; // requests on kept connections, and idle ones closed for new ones
+int connections_max_busy = 0; // the most slots ever in use at once
+long requests_limited = 0, requests_over_budget = 0; // requests refused because of a client's limit, or everyone's
+static struct bucket_t web_budget = {WEB_BURST, 0 }; // the requests we'll answer from all the clients together
+static int turn_responses = 0; // how many full responses we've made in this call of process_web()
+static bool web_limits = true; // do we use those limits? (The "flood" command also tries without.)
+
+static unsigned long stack_web_depth = 0; // the stack depth in process_web(), when we're in it
+
+/* The images are sent with an ETag that is a hash of their contents, and the browser is told
+   to cache them forever. The button image is referred to with the hash in its URL, and so is
+   the icon, so a new image after a software update gets a new URL and is fetched again.
+   If a browser asks anyway and already has this version, we just say "304 Not Modified".
+   The hash is calculated the first time it's needed, so it can't get out of date if an
+   image is regenerated by binary_to_c. */
+extern char iconimagejpg[];    // binary jpg encoding of the icon image
+extern int iconimagesize;      // its length
+extern char buttonimagejpg[];  // binary jpg encoding of the button image
+extern int buttonimagesize;    // its length
+#define IMAGE_CACHE_CONTROL "Cache-Control: public, max-age=31536000, immutable\r\n"
+static const char *not_modified_etag = NULL; // the ETag for a 304 response
+#define FNV_OFFSET 2166136261UL // for FNV-1a hashing
+#define FNV_PRIME 16777619UL
+
+static const char *image_etag(bool button) { // the quoted FNV-1a hash of the icon or button image
+   static char etags[2][11];
+   char *etag = etags[button];
+   if (etag[0] == 0) {
+      const char *data = button ? buttonimagejpg : iconimagejpg;
+      int size = button ? buttonimagesize : iconimagesize;
+      uint32_t hash = FNV_OFFSET;
+      for (int ndx = 0; ndx < size; ++ndx) hash = (hash ^ (byte)data[ndx]) * FNV_PRIME;
+      sprintf(etag, "\"%08lX\"", (unsigned long)hash); }
+   return etag; }
+
+// What we send is collected in a buffer, and sent to the WiFi module in chunks. It can't take
+// long transfers all at once (the images are 20K), and it needs some time between chunks, so
+// we never send more than 500 bytes at once, or more often than every 10 msec. If it refuses a
+// chunk, we use smaller chunks with more time between them from then on. As it takes them, we
+// gradually go back to the biggest and fastest.
+
+static char client_buffer[CLIENT_BUFFER_SIZE];
+static int client_buffered = 0;         // how many bytes are in it,
+static bool client_buffering = false;   //   if we're using it
+static int client_header_end = -1;      // where the end of the HTTP header goes, if we left it open
+static bool client_keep_alive = false;  // may the connection stay open after this response?
+static int chunk_size = CHUNK_MAX;      // what the WiFi module has recently been able to take,
+static int chunk_delay_msec = CHUNK_DELAY_MIN; // and how long it needed between chunks
+long chunk_refusals = 0;                // how many times it couldn't take a chunk
+
+bool client_send(WiFiClient *pclient, const char *buf, int length) { // send data to the WiFi module
+   int refusals = 0;
    while (length > 0) {
-      //Serial.print(length); Serial.print(" bytes to write; ");
       if (!pclient->connected()) {
          //Serial.print("at time "); Serial.print((float)millis() / 1000);
          //Serial.println(" client no longer connected");
          return false; }
-      int bytes_done = pclient->write(buf, length > CHUNKSIZE ? CHUNKSIZE : length); //TEMP server.write???
-      if (HTML_SHOW_RSP) {
-         showing_screen = false;
-         Serial.print("at time "); Serial.print((float)millis() / 1000); Serial.print(" wrote ");
-         if (show) {
-            Serial.print(bytes_done); Serial.print(" bytes: ");
-            if (bytes_done < MAXLINE) Serial.write(buf, bytes_done);
-            else {
-               Serial.write(buf, MAXLINE);
-               Serial.write("...\n"); } }
+      int bytes_done = pclient->write(buf, length > chunk_size ? chunk_size : length);
+      if (rsp_counting) ++rsp_counting->writes;
+      if (bytes_done <= 0) { // it couldn't take it
+         ++chunk_refusals;
+         chunk_size = chunk_size / 2 > CHUNK_MIN ? chunk_size / 2 : CHUNK_MIN;
+         chunk_delay_msec = chunk_delay_msec * 2 < CHUNK_DELAY_MAX ? chunk_delay_msec * 2 : CHUNK_DELAY_MAX;
+         if (++refusals > CHUNK_REFUSALS) return false; }
+      else {
+         if (rsp_counting) rsp_counting->bytes += bytes_done;
+         length -= bytes_done;
+         buf += bytes_done;
+         if (chunk_size < CHUNK_MAX) chunk_size = chunk_size + CHUNK_MIN < CHUNK_MAX ? chunk_size + CHUNK_MIN : CHUNK_MAX;
+         else if (chunk_delay_msec > CHUNK_DELAY_MIN) --chunk_delay_msec; }
+      if (length > 0) delay(chunk_delay_msec); // time for something to happen on the co-processor
+   }
+   return true; }
+
+// A response can leave the connection open for another request only if the browser can tell
+// where it ends, so it needs a Content-Length. If we don't know the length when we write the
+// header, we leave the end of the header open in the buffer and fill it in later: with the
+// length if the whole response fits in the buffer, or with "Connection: close" if it doesn't.
+
+static void client_header_insert(const char *text) { // fill in the end of the header we left open
+   int length = strlen(text);
+   memmove(client_buffer + client_header_end + length, client_buffer + client_header_end,
+           client_buffered - client_header_end);
+   memcpy(client_buffer + client_header_end, text, length);
+   client_buffered += length;
+   client_header_end = -1; }
+
+void client_buffer_start(void) { // start collecting what we send
+   client_buffered = 0;
+   client_header_end = -1;
+   client_buffering = true; }
+
+bool client_flush(WiFiClient *pclient) { // send what we collected, and stop collecting
+   if (client_header_end >= 0) { // it all fit, so now we know how long it is
+      char text[HEADER_END_RESERVE];
+      sprintf(text, "Content-Length: %d\r\nConnection: keep-alive\r\n\r\n", client_buffered - client_header_end);
+      client_header_insert(text); }
+   bool ok = client_send(pclient, client_buffer, client_buffered);
+   client_buffered = 0;
+   client_buffering = false;
+   return ok; }
+
+bool client_write(WiFiClient *pclient, const char *buf, int length, bool show) {
+   if (HTML_SHOW_RSP) {
+      showing_screen = false;
+      Serial.print("at time "); Serial.print((float)millis() / 1000); Serial.print(" wrote ");
+      if (show) {
+         Serial.print(length); Serial.print(" bytes: ");
+         if (length < MAXLINE) Serial.write(buf, length);
          else {
-            Serial.print(bytes_done); Serial.print(" bytes of binary data\n"); } }
+            Serial.write(buf, MAXLINE);
+            Serial.write("...\n"); } }
+      else {
+         Serial.print(length); Serial.print(" bytes of binary data\n"); } }
+   if (!client_buffering) return client_send(pclient, buf, length);
+   while (length > 0) { // add it to the buffer, sending the buffer whenever it fills
+      int buffer_size = client_header_end >= 0 ? CLIENT_BUFFER_SIZE - HEADER_END_RESERVE : CLIENT_BUFFER_SIZE;
+      if (client_buffered >= buffer_size) {
+         if (client_header_end >= 0) { // too long to say how long, so the connection will be closed
+            client_keep_alive = false;
+            client_header_insert("Connection: close\r\n\r\n");
+            continue; }
+         if (!client_send(pclient, client_buffer, client_buffered)) return false;
+         client_buffered = 0; }
+      int bytes_done = buffer_size - client_buffered;
+      if (bytes_done > length) bytes_done = length;
+      memcpy(client_buffer + client_buffered, buf, bytes_done);
+      client_buffered += bytes_done;
       length -= bytes_done;
-      buf += bytes_done;
-      delay(10); // time for something to happen on the co-processor??
-   }
+      buf += bytes_done; }
    return true; }
 
 void client_printf(WiFiClient *pclient, const char *format, ...) {
@@ -131,11 +401,68 @@ void client_printf(WiFiClient *pclient, const char *format, ...) {
    client_write(pclient, buf, strlen(buf), true);
    va_end(argptr); }
 
-char *expand_arrows_and_blanks(char *msg) { // expand our arrow symbols into HTML arrows, blanks into &nbsp
+void http_header_end(WiFiClient *pclient, long content_length) { // finish an HTTP response header
+   // content_length is -1 if we don't know it yet, or NO_BODY
+   if (content_length >= 0) client_printf(pclient, "Content-Length: %ld\r\n", content_length);
+   else if (content_length != NO_BODY) {
+      if (client_keep_alive && client_buffering) {
+         client_header_end = client_buffered; // finish it when we know
+         return; }
+      client_keep_alive = false; }
+   client_printf(pclient, client_keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n"); }
+
+// A compact JSON writer that sends as it goes, without building the whole thing in memory.
+// Each value is preceded by its name, unless it's in an array, and by a comma if needed.
+
+static bool json_first; // is the next value the first in its object or array?
+
+static void json_name(WiFiClient *pclient, const char *name) {
+   if (!json_first) client_write(pclient, ",", 1, true);
+   if (name) client_printf(pclient, "\"%s\":", name);
+   json_first = false; }
+
+static void json_open(WiFiClient *pclient, const char *name, char bracket) { // start an object or array
+   json_name(pclient, name);
+   client_write(pclient, &bracket, 1, true);
+   json_first = true; }
+
+static void json_close(WiFiClient *pclient, char bracket) {
+   client_write(pclient, &bracket, 1, true);
+   json_first = false; }
+
+static void json_bool(WiFiClient *pclient, const char *name, bool val) {
+   json_name(pclient, name);
+   client_printf(pclient, val ? "true" : "false"); }
+
+static void json_int(WiFiClient *pclient, const char *name, long val) {
+   json_name(pclient, name);
+   client_printf(pclient, "%ld", val); }
+
+static void json_float(WiFiClient *pclient, const char *name, float val) {
+   json_name(pclient, name);
+   client_printf(pclient, "%.1f", val); }
+
+static void json_string(WiFiClient *pclient, const char *name, const char *val) {
+   json_name(pclient, name);
+   if (!val) {
+      client_printf(pclient, "null");
+      return; }
+   client_write(pclient, "\"", 1, true);
+   for (; *val; ++val) {
+      if (*val == '"' || *val == '\\') client_printf(pclient, "\\%c", *val);
+      else if (*val == LEFTARROW[0]) client_printf(pclient, "\\u2190"); // our arrow glyphs
+      else if (*val == UPARROW[0]) client_printf(pclient, "\\u2191");
+      else if (*val == RIGHTARROW[0]) client_printf(pclient, "\\u2192");
+      else if (*val == DOWNARROW[0]) client_printf(pclient, "\\u2193");
+      else if ((byte)*val < ' ' || (byte)*val >= 0x7f) client_printf(pclient, "\\u%04x", (byte)*val);
+      else client_write(pclient, val, 1, true); }
+   client_write(pclient, "\"", 1, true); }
+
+char *expand_arrows_and_blanks(const char *msg) { // expand our arrow symbols into HTML arrows, blanks into &nbsp
    // WARNING: returns pointer to a static string!
    static char outmsg[MAXLINE];
    char *dst = outmsg;
-   for (char *src = msg; *src; ++src) {
+   for (const char *src = msg; *src; ++src) {
       if (*src == LEFTARROW[0]) {
          strcpy(dst, "&#8592;"); dst += 6; }
       else if (*src == UPARROW[0]) {
@@ -150,35 +477,78 @@ char *expand_arrows_and_blanks(char *msg) { // expand our arrow symbols into HTM
    *dst = 0;
    return outmsg; }
 
-struct client_t * add_IP_address(WiFiClient *pclient) { // record this IP address in our table
-   IPAddress addr = pclient->remoteIP();
-   int empty_ndx = -1, min_ndx = -1, min_count = INT_MAX;
-   for (int ndx = 0; ndx < MAX_IP_ADDRESSES; ++ndx) {
-      if (clients[ndx].ip_address == addr) {// IP address is already in the table
-         clients[ndx].recent_time = now();
-         return &clients[ndx]; }
-      if (clients[ndx].count == 0) empty_ndx = ndx; // remember empty slot
-      else if (clients[ndx].count < min_count) { // remember min count slot
-         min_ndx = ndx; min_count = clients[ndx].count; } }
-   if (empty_ndx >= 0) min_ndx = empty_ndx;
-   clients[min_ndx].ip_address = addr; // create a new entry for it
-   clients[min_ndx].count = 1;
-   clients[min_ndx].gave_password = false;
-   clients[min_ndx].first_time = clients[min_ndx].recent_time = now();
-   return &clients[min_ndx]; }
-
-void sort_clients(void) { // sort the client array by most-recent visit time
-   int next = 1;  // next element to sort in the insertion sort
-   while (next < MAX_IP_ADDRESSES) {
-      struct client_t temp;
-      int insert;
-      temp = clients[next];
-      insert = next - 1; // possible place to insert it
-      while (insert >= 0 && clients[insert].recent_time < temp.recent_time) {
-         clients[insert + 1] = clients[insert];
-         --insert; }
-      clients[insert + 1] = temp;
-      ++next; } }
+/* We find a visitor's entry in clients[] from their IP address with an open-addressed hash
+   table using linear probing, and keep the entries in a doubly-linked list ordered by their
+   most recent visit. So looking up a visitor, moving them to the front, and replacing the
+   one who visited least long ago when the table is full all take constant time, and the
+   /visitors page is already in order. */
+
+static unsigned ip_hash(IPAddress addr) { // the hash slot to start looking for this IP address
+   uint32_t val = ((uint32_t)addr[0] << 24) | ((uint32_t)addr[1] << 16) | ((uint32_t)addr[2] << 8) | addr[3];
+   return (uint32_t)(val * 2654435761u) >> (32 - IP_HASH_BITS); } // Knuth's multiplicative hash
+
+static int ip_find(IPAddress addr, unsigned *pslot) { // find the index of an IP address, or return -1
+   unsigned slot = ip_hash(addr); // either way, return the slot it's in or should go in
+   while (client_hash[slot] != 0) {
+      int ndx = client_hash[slot] - 1;
+      if (clients[ndx].ip_address == addr) {
+         *pslot = slot;
+         return ndx; }
+      slot = (slot + 1) & (IP_HASH_SIZE - 1); }
+   *pslot = slot;
+   return -1; }
+
+static void ip_unhash(unsigned slot) { // empty a hash slot, and close the gap in the probe sequence
+   unsigned next = slot;
+   client_hash[slot] = 0;
+   while (1) { // move back any later entry that couldn't be found past the now-empty slot
+      next = (next + 1) & (IP_HASH_SIZE - 1);
+      if (client_hash[next] == 0) break;
+      unsigned home = ip_hash(clients[client_hash[next] - 1].ip_address);
+      if (((next - home) & (IP_HASH_SIZE - 1)) >= ((next - slot) & (IP_HASH_SIZE - 1))) {
+         client_hash[slot] = client_hash[next];
+         client_hash[next] = 0;
+         slot = next; } } }
+
+static void client_unlink(int ndx) { // remove an entry from the list by recent visit
+   struct client_t *pc = &clients[ndx];
+   if (pc->newer >= 0) clients[pc->newer].older = pc->older;
+   else newest_client = pc->older;
+   if (pc->older >= 0) clients[pc->older].newer = pc->newer;
+   else oldest_client = pc->newer; }
+
+static void client_link(int ndx) { // put an entry at the front of the list by recent visit
+   clients[ndx].newer = -1;
+   clients[ndx].older = newest_client;
+   if (newest_client >= 0) clients[newest_client].newer = ndx;
+   else oldest_client = ndx;
+   newest_client = ndx; }
+
+struct client_t * add_IP_address(IPAddress addr) { // record this IP address in our table
+   unsigned slot;
+   int ndx = ip_find(addr, &slot);
+   if (ndx >= 0) { // IP address is already in the table
+      clients[ndx].recent_time = now();
+      client_unlink(ndx);
+      client_link(ndx);
+      return &clients[ndx]; }
+   if (num_clients < MAX_IP_ADDRESSES) ndx = num_clients++; // use an unused entry
+   else { // or replace the visitor we haven't seen for the longest time
+      unsigned old_slot;
+      ndx = oldest_client;
+      ip_find(clients[ndx].ip_address, &old_slot);
+      ip_unhash(old_slot);
+      client_unlink(ndx);
+      ip_find(addr, &slot); } // (its slot may have changed)
+   client_hash[slot] = ndx + 1;
+   clients[ndx].ip_address = addr; // create a new entry for it
+   clients[ndx].count = 0;
+   clients[ndx].gave_password = false;
+   clients[ndx].bucket.tokens = CLIENT_BURST;
+   clients[ndx].bucket.refill_millis = millis();
+   clients[ndx].first_time = clients[ndx].recent_time = now();
+   client_link(ndx);
+   return &clients[ndx]; }
 
 char *format_ip_address(IPAddress addr) {
    // WARNING: returns pointer to a static string!
@@ -261,8 +631,6 @@ void print_client_info(const char *msg, WiFiClient *pclient, byte status) {
 
 void queue_button_push(int button) {  // queue a button push
    button_webpushed[button] = true;
-   delayed_response = true; // queue a delayed response after the button push happens
-   delayed_sendtime = millis() + DELAYED_RSP_MSEC;
    if (DEBUG) {
       Serial.print("queuing a delayed response after pushing button ");
       Serial.println(button);
@@ -271,121 +639,983 @@ void queue_button_push(int button) {  // queue a button push
 bool check_password (char *ptr) {
    return strcmp(ptr, ACTION_PASSWORD) == 0; }
 
-bool get_request_line(WiFiClient *pclient, char *ptr) {
-   int nbytes = pclient->readBytesUntil('\n', ptr, MAXLINE - 1);
-   ptr[nbytes] = 0;
-   //if (ptr[0] != 0 && ptr[0] != '\n') Serial.println(ptr);
-   return nbytes > 1; }
+// A request is read a piece at a time, as it arrives, by request_read() below.
+// A hostile or broken client can't make us overrun the line buffer, or keep us for long.
 
-bool check_for_client(const char *msg) {
-   byte status;
-   client = server.available(&status);
-   if (client) {
-      #if DEBUG
-      print_client_info(msg, &client, status);
-      #endif
+/* As the request line arrives we hash its method and path, and as each header line arrives we
+   hash its name. The routes and the headers we use are case labels of a switch on that hash,
+   which the compiler works out from their names, so finding one takes the same time however
+   many there are, and the compiler complains if two of them have the same hash. A match is
+   then checked against the name, in case something else has the same hash. (The hash is
+   FNV-1a, as for the image ETags.) A header we don't
+   use is skipped as soon as we see its name, without keeping the rest of it. */
+
+constexpr uint32_t fnv_hash(const char *str, uint32_t hash = FNV_OFFSET) { // (at compile time)
+   return *str ? fnv_hash(str + 1, (uint32_t)((hash ^ (byte)*str) * FNV_PRIME)) : hash; }
+
+static bool key_matches(const char *key, const char *str, int length) { // case-insensitive
+   for (; length > 0; --length)
+      if (*key++ != toupper(*str++)) return false;
+   return *key == 0; }
+
+static enum request_type_t request_route(const char *line, int length, uint32_t hash) {
+   // which request this method and path is, in upper case, or REQ_UNKNOWN
+   const char *route = NULL;
+   enum request_type_t type = REQ_UNKNOWN;
+   switch (hash) {
+#define ROUTE(name, request_type) case fnv_hash(name): route = name; type = request_type; break;
+         ROUTE("GET /", REQ_ROOT)
+         ROUTE("GET /VISITORS", REQ_VISITORS)
+         ROUTE("GET /LOG", REQ_LOG)
+         ROUTE("GET /LOG.JSON", REQ_LOGJSON)
+         ROUTE("GET /LOG.CSV", REQ_LOGCSV)
+         ROUTE("GET /LOG.BIN", REQ_LOGBIN)
+         ROUTE("GET /FAVICON.ICO", REQ_FAVICON)
+         ROUTE("GET /BUTTONIMAGE.JPG", REQ_BUTTONIMAGE)
+         ROUTE("GET /STATS", REQ_STATS)
+         ROUTE("GET /PROFILE", REQ_PROFILE)
+         ROUTE("GET /TRACE.TXT", REQ_TRACE)
+         ROUTE("GET /STATUS.JSON", REQ_JSON)
+         ROUTE("GET /EVENTS", REQ_EVENTS)
+         ROUTE("GET /METRICS", REQ_METRICS)
+         ROUTE("GET /CONFIG", REQ_CONFIG)
+         ROUTE("GET /CONFIG.JSON", REQ_CONFIGJSON)
+         ROUTE("POST /CONFIG.HTML", REQ_SETCONFIG)
+         ROUTE("PUT /CONFIG.JSON", REQ_PUTCONFIG)
+         ROUTE("POST /PUSHBUTTON.HTML", REQ_PUSHBUTTON)
+         ROUTE("POST /SETPASS.HTML", REQ_SETPASS)
+#undef ROUTE
+   }
+   return route && key_matches(route, line, length) ? type : REQ_UNKNOWN; }
+
+enum header_t {HDR_OTHER, HDR_CONTENT_LENGTH, HDR_CONNECTION, HDR_IF_NONE_MATCH };
+
+static enum header_t request_header(const char *line, int length, uint32_t hash) {
+   // which header this name, in upper case, is, or HDR_OTHER if it's one we don't use
+   const char *name = NULL;
+   enum header_t header = HDR_OTHER;
+   switch (hash) {
+#define HEADER(string, header_type) case fnv_hash(string): name = string; header = header_type; break;
+         HEADER("CONTENT-LENGTH", HDR_CONTENT_LENGTH)
+         HEADER("CONNECTION", HDR_CONNECTION)
+         HEADER("IF-NONE-MATCH", HDR_IF_NONE_MATCH)
+#undef HEADER
+   }
+   return name && key_matches(name, line, length) ? header : HDR_OTHER; }
+
+static void request_next_line(struct web_request_t *preq) { // get ready for the next line
+   preq->line_length = 0;
+   preq->line_truncated = false;
+   preq->line_part = LINE_KEY;
+   preq->key_hash = FNV_OFFSET;
+   preq->key_length = 0;
+   preq->key_spaces = 0; }
+
+static void request_start(struct web_request_t *preq) { // get ready to read a new request
+   memset(preq, 0, sizeof(*preq));
+   preq->type = REQ_UNKNOWN;
+   preq->button = -1;
+   preq->content_length = -1;
+   preq->log_since = -1;
+   preq->config_bad = -1;
+   request_next_line(preq);
+   preq->start_millis = preq->idle_start_millis = millis(); }
+
+static bool request_key(struct web_request_t *preq, int ch) {
+   // Hash the method and path of the request line, or the name of a header, as it arrives.
+   // Return true if we don't need to keep this character, because it's in a header we don't use.
+   if (preq->line_part == LINE_SKIP) return true;
+   bool key_end = preq->lines == 0 // the method and path end at a query, the second blank, or the end
+                  ? ch == '?' || ch == '\r' || (ch == ' ' && preq->key_spaces++ > 0)
+                  : ch == ':';   // and a header's name at the colon
+   if (!key_end) {
+      preq->key_hash = (uint32_t)((preq->key_hash ^ (byte)toupper(ch)) * FNV_PRIME);
+      return false; }
+   preq->line_part = LINE_VALUE;
+   preq->key_length = preq->line_length;
+   if (preq->lines > 0 && request_header(preq->line, preq->key_length, preq->key_hash) == HDR_OTHER) {
+      preq->line_part = LINE_SKIP; // we don't need the rest
+      return true; }
+   return false; }
+
+static void request_log_params(char *ptr, struct web_request_t *preq) { // parse "?since=S&limit=N"
+   if (*ptr == '?') ++ptr;
+   while (*ptr && *ptr != ' ') {
+      long num;
+      if (scan_key(&ptr, "SINCE=") && (num = strtol(ptr, &ptr, 10)) >= 0) preq->log_since = num;
+      else if (scan_key(&ptr, "LIMIT=") && (num = strtol(ptr, &ptr, 10)) >= 0) preq->log_limit = num;
+      while (*ptr && *ptr != ' ' && *ptr != '&') ++ptr; // (ignore what we don't know)
+      if (*ptr == '&') ++ptr; } }
+
+static char *url_decode(char *ptr) { // decode a form's value in place: + is a blank, and %xx a character
+   char *dst = ptr;
+   for (char *src = ptr; *src; ++dst) {
+      if (*src == '+') { *dst = ' '; ++src; }
+      else if (src[0] == '%' && isxdigit(src[1]) && isxdigit(src[2])) {
+         char hex[3] = {src[1], src[2], 0};
+         *dst = (char)strtol(hex, NULL, 16);
+         src += 3; }
+      else *dst = *src++; }
+   *dst = 0;
+   return ptr; }
+
+static char *json_unquote(char **pptr) {
+   // decode a JSON string in place, from after its opening quote, leaving *pptr after the closing one
+   char *src = *pptr, *dst = *pptr, *value = *pptr;
+   while (*src && *src != '"') {
+      if (*src == '\\' && src[1]) { // an escape: we only expect \" and \\, but take the common ones
+         ++src;
+         *dst++ = *src == 'n' ? '\n' : *src == 't' ? '\t' : *src == 'r' ? '\r' : *src;
+         ++src; }
+      else *dst++ = *src++; }
+   *pptr = *src ? src + 1 : src;
+   *dst = 0; // (at or before the closing quote)
+   return value; }
+
+static void request_config(char *ptr, struct web_request_t *preq) {
+   // Parse some of a configuration change: a form's "name=value&..." or JSON's {"name": value, ...},
+   // which may be on several lines. A value is a number, maybe "forever", or the password. A form's
+   // values are URL-encoded, and a JSON string can have anything in it up to its closing quote.
+   bool form = preq->type == REQ_SETCONFIG;
+   while (true) {
+      while (*ptr && strchr("{}\"&, \t\r", *ptr)) ++ptr; // the next name
+      if (!*ptr) return;
+      char *name = ptr;
+      while (isalnum(*ptr) || *ptr == '_') ++ptr;
+      int length = ptr - name;
+      if (*ptr == '"') ++ptr; // (the end of a JSON name)
+      while (*ptr && strchr(" \t:=", *ptr)) ++ptr; // its value
+      char *value = ptr;
+      char end = 0;
+      if (!form && *ptr == '"') {
+         ++ptr;
+         value = json_unquote(&ptr); }
+      else {
+         while (*ptr && !strchr(form ? "&\r" : ",}\r", *ptr)) ++ptr;
+         end = *ptr;
+         *ptr = 0; // (for now)
+         if (form) url_decode(value); }
+      if (length == 3 && strncasecmp(name, "pwd", 3) == 0) {
+         if (check_password(value)) preq->password_ok = true; }
+      else {
+         unsigned ndx = 0;
+         while (ndx < NUM_CONFIG_FIELDS
+                && !(strncasecmp(name, config_fields[ndx].name, length) == 0 && config_fields[ndx].name[length] == 0)) ++ndx;
+         const struct config_field_t *pf = &config_fields[ndx];
+         char *endptr;
+         long val = strtol(value, &endptr, 10);
+         while (*endptr == ' ' || *endptr == '\t') ++endptr;
+         if (ndx < NUM_CONFIG_FIELDS && pf->forever && strncasecmp(value, "forever", 7) == 0) val = FOREVER;
+         else if (ndx >= NUM_CONFIG_FIELDS || endptr == value || *endptr || val < pf->min || val > pf->max) {
+            if (preq->config_bad < 0) preq->config_bad = ndx;
+            val = -1; }
+         if (val >= 0) {
+            preq->config_values[ndx] = val;
+            preq->config_given |= 1 << ndx; } }
+      if (end) *ptr = end; } }
+
+static bool request_line(struct web_request_t *preq) {
+   // Parse the line we've read. Return false if the request ended, or was rejected.
+   char *ptr = preq->line;
+   enum line_part_t part = (enum line_part_t)preq->line_part;
+   int key_length = part == LINE_KEY ? preq->line_length : preq->key_length;
+   uint32_t key_hash = preq->key_hash;
+   preq->line[preq->line_length] = 0;
+   request_next_line(preq);
+   if (++preq->lines > MAX_REQUEST_LINES) {
+      ++parse_stats.too_many_lines;
+      preq->rejected = true;
+      return false; }
+   if (part == LINE_SKIP) return true; // a header we don't use
+   if (HTML_SHOW_REQ) {
+      // Serial.print() ignores embedded \r\n character sequences!
+      Serial.print("  "); Serial.println(ptr);
+      showing_screen = false; }
+   if (!preq->in_body) { // the header
+      if (strlen(ptr) <= 1) { // an empty line, or just \r, ends it
+         if (preq->lines == 1) { // unless it's before the request, which some browsers send after a POST
+            --preq->lines;
+            return true; }
+         preq->in_body = true; // is there a body? (We read it even if we don't care, so the next request is next.)
+         return preq->content_length > 0
+                || ((preq->type == REQ_PUSHBUTTON || preq->type == REQ_SETPASS
+                     || preq->type == REQ_SETCONFIG || preq->type == REQ_PUTCONFIG) && preq->content_length != 0); }
+      if (preq->lines == 1) { // the request line
+         preq->keep_alive = strstr(ptr, " HTTP/1.1") != NULL; // HTTP/1.1 keeps the connection open unless told otherwise
+         preq->type = request_route(ptr, key_length, key_hash);
+         if (preq->type == REQ_LOG || preq->type == REQ_LOGJSON || preq->type == REQ_LOGCSV || preq->type == REQ_LOGBIN)
+            request_log_params(ptr + key_length, preq);
+         return true; }
+      if (part != LINE_VALUE) return true; // (not a header)
+      ptr += key_length + 1; // the header's value, after the colon
+      switch (request_header(preq->line, key_length, key_hash)) {
+         case HDR_CONTENT_LENGTH: {
+               int length;
+               skip_blanks(&ptr);
+               if (scan_int(&ptr, &length, 0, MAX_REQUEST_BYTES)) preq->content_length = length; }
+            break;
+         case HDR_CONNECTION:
+            for (char *cp = ptr; *cp; ++cp) *cp = toupper(*cp);
+            if (strstr(ptr, "CLOSE")) preq->keep_alive = false;
+            else if (strstr(ptr, "KEEP-ALIVE")) preq->keep_alive = true;
+            break;
+         case HDR_IF_NONE_MATCH:
+            if (preq->type == REQ_FAVICON || preq->type == REQ_BUTTONIMAGE) { // does it have this image?
+               for (char *cp = ptr; *cp; ++cp) *cp = toupper(*cp);
+               skip_blanks(&ptr);
+               preq->have_image = *ptr == '*' || strstr(ptr, image_etag(preq->type == REQ_BUTTONIMAGE)) != NULL; }
+            break;
+         case HDR_OTHER:
+            break; }
+      return true; }
+   // the POST body
+   int button;
+   if (preq->type == REQ_PUSHBUTTON) {
+      if (scan_key(&ptr, "BUTTON=") && scan_int(&ptr, &button, 0, NUM_BUTTONS - 1))
+         preq->button = button; }
+   else if (preq->type == REQ_SETPASS && *ptr) {
+      preq->got_body = true;
+      if (scan_key(&ptr, "PWD=") && check_password(url_decode(ptr))) preq->password_ok = true; }
+   else if (preq->type == REQ_SETCONFIG || preq->type == REQ_PUTCONFIG)
+      request_config(ptr, preq);
+   return preq->content_length < 0 || preq->body_bytes < preq->content_length; }
+
+static bool request_receive(WiFiClient *pclient, struct web_request_t *preq) {
+   // Read and parse whatever has arrived, without waiting for more. Return true if the request
+   // is done: it ended, or the client went away or quiet, or it had too many lines or bytes or
+   // took too long, in which case it's rejected. A body without a newline ends at its
+   // Content-Length, or if we weren't told that, when nothing more comes for a while.
+   if (millis() - preq->start_millis > MAX_REQUEST_MSEC) {
+      ++parse_stats.too_slow;
+      preq->rejected = true;
+      return true; }
+   while (pclient->available() > 0) {
+      int ch = pclient->read();
+      if (ch < 0) break;
+      preq->idle_start_millis = millis();
+      if (++preq->bytes > MAX_REQUEST_BYTES) {
+         ++parse_stats.too_many_bytes;
+         preq->rejected = true;
+         return true; }
+      if (preq->in_body) ++preq->body_bytes;
+      if (ch != '\n') {
+         if (!preq->in_body && preq->line_part != LINE_VALUE && request_key(preq, ch))
+            continue; // (part of a header we don't use)
+         if (preq->line_length < MAXLINE - 1) preq->line[preq->line_length++] = ch;
+         else if (!preq->line_truncated) {
+            ++parse_stats.long_lines;
+            preq->line_truncated = true; } }
+      if ((ch == '\n' || (preq->in_body && preq->body_bytes == preq->content_length))
+            && !request_line(preq)) return true; }
+   if (!pclient->connected() || millis() - preq->idle_start_millis >= REQUEST_IDLE_MSEC) {
+      if (preq->line_length > 0) request_line(preq); // take what we have
       return true; }
    return false; }
 
-void generate_response(WiFiClient *pclient, enum response_type_t response_type) {
+bool request_read(WiFiClient *pclient, struct web_request_t *preq) { // read more of a request; return true when done
+   if (!request_receive(pclient, preq)) return false;
+   unsigned long elapsed_millis = millis() - preq->start_millis;
+   ++parse_stats.requests;
+   parse_stats.lines += preq->lines;
+   parse_stats.bytes += preq->bytes;
+   if (preq->bytes > parse_stats.max_bytes) parse_stats.max_bytes = preq->bytes;
+   if (elapsed_millis > parse_stats.max_msecs) parse_stats.max_msecs = elapsed_millis;
+   return true; }
+
+void client_print_line(const char *line, void *pclient) {
+   client_printf((WiFiClient *)pclient, "%s\r\n", line); }
+
+static void format_timing(char *string, const char *title, struct timing_histogram_t *ph) {
+   // put the non-empty buckets of a timing histogram on one line
+   int length = sprintf(string, "%s in msec:", title);
+   const char *separator = " ";
+   for (int bucket = 0; bucket < TIMING_BUCKETS; ++bucket)
+      if (ph->counts[bucket] > 0 && length < MAXLINE - 40) {
+         unsigned long lo = bucket == 0 ? 0 : 1UL << (bucket - 1);
+         unsigned long hi = bucket == 0 ? 0 : 2 * lo - 1;
+         if (bucket == TIMING_BUCKETS - 1)
+            length += sprintf(string + length, "%s%lu+: %lu", separator, lo, ph->counts[bucket]);
+         else if (lo == hi)
+            length += sprintf(string + length, "%s%lu: %lu", separator, lo, ph->counts[bucket]);
+         else length += sprintf(string + length, "%s%lu-%lu: %lu", separator, lo, hi, ph->counts[bucket]);
+         separator = ", "; }
+   sprintf(string + length, "%s; max %lu", *separator == ' ' ? " none" : "", ph->max_msec); }
+
+void show_timing(WiFiClient *pclient, const char *title, struct timing_histogram_t *ph) {
+   char string[MAXLINE];
+   format_timing(string, title, ph);
+   client_printf(pclient, "%s<br>\r\n", string); }
+
+// A client watching /events keeps its connection open in its slot, and we send it what changed.
+// Other requests are served meanwhile.
+
+long events_sent = 0;           // how many events we sent, to all clients
+
+static byte events_status_bits(void) {
+   return util_on.val | gen_on.val << 1 | util_connected.val << 2 | gen_connected.val << 3
+          | rungenrelay << 4 | connectgenrelay << 5 | athome << 6; }
+
+static void events_start(struct connection_t *pc) { // start sending events to this client
+   WiFiClient *pclient = pc->pclient;
+   pc->state = CONN_EVENTS;
+   for (int row = 0; row < 4; ++row) strcpy(pc->events_lcdbuf[row], "\xff"); // send everything first
+   pc->events_status = 0xff;
+   pc->events_check_millis = millis() - EVENTS_MSEC; // (look right away)
+   pc->events_sent_millis = millis();
+   client_buffer_start();
+   client_printf(pclient, "HTTP/1.1 200 OK\r\n");
+   client_printf(pclient, "Content-Type: text/event-stream\r\n");
+   client_printf(pclient, "Cache-Control: no-cache\r\n\r\n");
+   client_printf(pclient, "retry: 10000\n\n"); // (how long to wait before reconnecting)
+   if (!client_flush(pclient)) {
+      pclient->stop();
+      pc->state = CONN_FREE; } }
+
+static void events_update(struct connection_t *pc) { // send this /events client whatever changed
+   WiFiClient *pclient = pc->pclient;
+   if (millis() - pc->events_check_millis < EVENTS_MSEC) return;
+   pc->events_check_millis = millis();
+   if (!pclient->connected()) { // it went away
+      pclient->stop();
+      pc->state = CONN_FREE;
+      return; }
+   bool sending = false;
+   client_buffer_start();
+   for (int row = 0; row < 4; ++row)
+      if (strcmp(lcdbuf[row], pc->events_lcdbuf[row]) != 0) {
+         strcpy(pc->events_lcdbuf[row], lcdbuf[row]);
+         client_printf(pclient, "event: lcd\ndata: ");
+         json_first = true;
+         json_open(pclient, NULL, '{');
+         json_int(pclient, "row", row);
+         json_string(pclient, "text", lcdbuf[row]);
+         json_close(pclient, '}');
+         client_printf(pclient, "\n\n");
+         ++events_sent;
+         sending = true; }
+   if (events_status_bits() != pc->events_status) {
+      pc->events_status = events_status_bits();
+      client_printf(pclient, "event: status\ndata: ");
+      json_first = true;
+      json_open(pclient, NULL, '{');
+      json_bool(pclient, "util_on", util_on.val);
+      json_bool(pclient, "gen_on", gen_on.val);
+      json_bool(pclient, "util_connected", util_connected.val);
+      json_bool(pclient, "gen_connected", gen_connected.val);
+      json_bool(pclient, "run_relay", rungenrelay);
+      json_bool(pclient, "connect_relay", connectgenrelay);
+      json_bool(pclient, "athome", athome);
+      json_close(pclient, '}');
+      client_printf(pclient, "\n\n");
+      ++events_sent;
+      sending = true; }
+   if (!sending && millis() - pc->events_sent_millis >= EVENTS_KEEPALIVE_MSEC) { // so we find out if it's gone
+      client_printf(pclient, ": keepalive\n\n");
+      sending = true; }
+   if (sending) {
+      set_activity(ACT_WEB_RESPONSE);
+      pc->events_sent_millis = millis(); }
+   if (!client_flush(pclient)) {
+      pclient->stop();
+      pc->state = CONN_FREE; } }
+
+// Which part of the log /log or /log.json shows: the entries after number log_since,
+// or the newest ones if it's -1, but no more than log_limit of them if it isn't 0.
+static long log_since = -1;
+static int log_limit = 0;
+
+static unsigned short config_get(const struct config_hdr_t *pconfig, const struct config_field_t *pf) {
+   const byte *ptr = (const byte *)pconfig + pf->offset;
+   return pf->size == 1 ? *ptr : *(const unsigned short *)ptr; }
+
+static void config_set(struct config_hdr_t *pconfig, const struct config_field_t *pf, unsigned short val) {
+   byte *ptr = (byte *)pconfig + pf->offset;
+   if (pf->size == 1) *ptr = val;
+   else *(unsigned short *)ptr = val; }
+
+// What happened to a configuration change, for RSP_CONFIG and RSP_CONFIGJSON, or NULL if there wasn't one,
+// and the HTTP status for it.
+static const char *config_msg = NULL;
+static const char *config_status = "200 OK";
+
+static void config_change(struct web_request_t *preq, struct client_t *visitor) {
+   // make a configuration change, if it's all good and the password was given with it
+   // (Unlike for the buttons, having given it before isn't enough, and this doesn't count as giving it.)
+   static char msg[80];
+   config_status = "200 OK";
+   if (!preq->password_ok) {
+      config_status = "403 Forbidden";
+      config_msg = "the password is needed; no changes made";
+      return; }
+   if (preq->config_bad >= 0) {
+      config_status = "400 Bad Request";
+      if (preq->config_bad >= (int)NUM_CONFIG_FIELDS) config_msg = "unknown setting; no changes made";
+      else {
+         const struct config_field_t *pf = &config_fields[preq->config_bad];
+         sprintf(msg, "%s must be %u to %u%s; no changes made", pf->name, pf->min, pf->max, pf->forever ? ", or forever" : "");
+         config_msg = msg; }
+      return; }
+   struct config_hdr_t new_config = config_hdr;
+   for (unsigned ndx = 0; ndx < NUM_CONFIG_FIELDS; ++ndx)
+      if (preq->config_given & (1 << ndx)) config_set(&new_config, &config_fields[ndx], preq->config_values[ndx]);
+   if (memcmp(&new_config, &config_hdr, sizeof(config_hdr)) == 0) {
+      config_msg = "no changes made";
+      return; }
+   config_hdr = new_config;
+   update_config(); // write it into EEPROM, all at once
+   IPAddress ip = visitor->ip_address;
+   log_eventf(EV_CONFIG_UPDATED, "from %d.%d.%d.%d", ip[0], ip[1], ip[2], ip[3]);
+   config_msg = "changes recorded"; }
+
+static bool log_range(unsigned long *pfirst, unsigned long *plast) {
+   // Find the numbers of the first and last log entries to show. Return false if there are none.
+   unsigned long newest = logfile_hdr.num_logged;
+   unsigned long oldest = newest - logfile_hdr.num_entries + 1;
+   unsigned long limit = log_limit > 0 ? log_limit : logfile_hdr.num_entries;
+   if (logfile_hdr.num_entries == 0) return false;
+   if (log_since >= 0) { // the oldest ones after the cursor
+      *pfirst = (unsigned long)log_since + 1 > oldest ? log_since + 1 : oldest;
+      if (*pfirst > newest) return false;
+      *plast = newest - *pfirst >= limit ? *pfirst + limit - 1 : newest; }
+   else { // the newest ones
+      *plast = newest;
+      *pfirst = newest - oldest >= limit ? newest - limit + 1 : oldest; }
+   return true; }
+
+static struct logentry_t *log_entry(unsigned long num) { // the log entry with this number
+   return &logfile[(logfile_hdr.newest + log_max_entries - (logfile_hdr.num_logged - num)) % log_max_entries]; }
+
+static char *log_msg(struct logentry_t *pe) { // the entry's message, 0-terminated, or NULL
+   static char string[LOG_MSGSIZE + 1];
+   if (!pe->msg[0]) return NULL;
+   memcpy(string, pe->msg, LOG_MSGSIZE);
+   string[LOG_MSGSIZE] = 0;
+   return string; }
+
+static void client_html(WiFiClient *pclient, const char *str) { // write text that HTML mustn't misread
+   for (; *str; ++str) {
+      if (*str == '<') client_printf(pclient, "&lt;");
+      else if (*str == '>') client_printf(pclient, "&gt;");
+      else if (*str == '&') client_printf(pclient, "&amp;");
+      else client_write(pclient, str, 1, true); } }
+
+// /log.csv and /log.bin are written without printf, since the log could be long.
+
+static char *csv_number(char *ptr, long num) { // add a number to a CSV line
+   char digits[12];
+   int ndigits = 0;
+   unsigned long val = num < 0 ? -(unsigned long)num : num;
+   if (num < 0) *ptr++ = '-';
+   do digits[ndigits++] = '0' + val % 10;
+   while (val /= 10);
+   while (ndigits) *ptr++ = digits[--ndigits];
+   *ptr++ = ',';
+   return ptr; }
+
+static char *csv_string(char *ptr, const char *str, int maxlength) { // add a quoted string to a CSV line
+   *ptr++ = '"';
+   for (int ndx = 0; ndx < maxlength && str[ndx]; ++ndx) {
+      if (str[ndx] == '"') *ptr++ = '"'; // (a quote is doubled)
+      *ptr++ = str[ndx]; }
+   *ptr++ = '"';
+   *ptr++ = ',';
+   return ptr; }
+
+static unsigned long phase_seconds(bool *pcounting_down) {
+   // how long what the display says we're waiting for has left, or has been going on
+   unsigned long secs = phase_secs;
+   int length = strlen(phase_msg); // is it counting down, like "generator off in" or "time left"?
+   *pcounting_down = (length >= 3 && strcmp(phase_msg + length - 3, " in") == 0)
+                     || (length >= 4 && strcmp(phase_msg + length - 4, "left") == 0);
+   if (*pcounting_down) secs = secs > (unsigned long)(now() - phase_datetime) ? secs - (now() - phase_datetime) : 0;
+   else secs += now() - phase_datetime;
+   return secs; }
+
+static unsigned long exercise_seconds_left(void) {
+   // how long the exercise has left, or 0 if it has run over (maybe because of a long wait)
+   unsigned long secs = MINS_TO_SECS(config_hdr.exer_duration_mins);
+   unsigned long elapsed = (millis() - exercise_start_millis) / 1000;
+   return elapsed < secs ? secs - elapsed : 0; }
+
+/* /metrics is the Prometheus text format, so that a Prometheus server can scrape every site.
+   It comes from this list of counters, which only go up until we restart, and gauges, which
+   are readings. Each is a long we keep, a bool that's 1 or 0, or a function that reads it.
+   The names get "generator_" in front, and counters get "_total" after; the counters are also
+   in the CNTR section of /log.bin, without those. A metric with a label is listed once for
+   each value of the label, and only the first has the help. */
+
+enum metric_type_t {METRIC_COUNTER, METRIC_GAUGE };
+
+static float metric_watchdog_resets(void) { return watchdog_counter(); }
+static float metric_log_entries_logged(void) { return logfile_hdr.num_logged; }
+static float metric_log_entries(void) { return logfile_hdr.num_entries; }
+static float metric_util_volts(void) { return analog(UTIL_VOLTAGE, VOLTAGE_EXAMPLE, VOLTAGE_ANALOG); }
+static float metric_gen_volts(void) { return analog(GEN_VOLTAGE, VOLTAGE_EXAMPLE, VOLTAGE_ANALOG); }
+static float metric_load_amps1(void) { return analog(LOAD_CURRENT1, CURRENT_EXAMPLE, CURRENT_ANALOG); }
+static float metric_load_amps2(void) { return analog(LOAD_CURRENT2, CURRENT_EXAMPLE, CURRENT_ANALOG); }
+static float metric_battery_volts(void) { return analog(BATT_VOLTAGE, BATT_EXAMPLE, BATT_ANALOG) + BATT_VOLTAGE_ADJ; }
+static float metric_exercise_seconds_left(void) {
+   return exercising ? exercise_seconds_left() : 0; }
+static float metric_phase(bool countdown) { // the phase timer, if it's going that way
+   bool counting_down;
+   if (!phase_msg) return 0;
+   unsigned long secs = phase_seconds(&counting_down);
+   return counting_down == countdown ? secs : 0; }
+static float metric_phase_seconds(void) { return metric_phase(false); }
+static float metric_phase_seconds_left(void) { return metric_phase(true); }
+static float metric_uptime_seconds(void) { return now() - startup_datetime; }
+static float metric_ram_free(void) { return ram_free(); }
+static float metric_connections_busy(void) {
+   int busy = 0;
+   for (int ndx = 0; ndx < MAX_CONNECTIONS; ++ndx)
+      if (connections[ndx].state != CONN_FREE) ++busy;
+   return busy; }
+
+static const struct metric_t { // a counter or gauge at /metrics
+   const char *name, *help;   // (the help is NULL for another label of the metric before)
+   enum metric_type_t type;
+   long *pval;                // where it is kept,
+   bool *pbool;               //   or the bool that it is,
+   float (*pfunc)(void); }    //   or the function that reads it
+metrics[] = {
+   {"requests", "Web requests processed.", METRIC_COUNTER, &requests_processed },
+   {"wifi_connects", "Connections to the WiFi network.", METRIC_COUNTER, &wifi_connects },
+   {"wifi_connectfails", "Failed attempts to connect to the WiFi network.", METRIC_COUNTER, &wifi_connectfails },
+   {"wifi_disconnects", "Times the WiFi network was lost.", METRIC_COUNTER, &wifi_disconnects },
+   {"wifi_resets", "Resets of the WiFi module.", METRIC_COUNTER, &wifi_resets },
+   {"ifttt_queues", "IFTTT triggers queued.", METRIC_COUNTER, &ifttt_queues },
+   {"ifttt_sends", "IFTTT triggers sent.", METRIC_COUNTER, &ifttt_sends },
+   {"ifttt_successes", "IFTTT triggers that succeeded.", METRIC_COUNTER, &ifttt_successes },
+   {"ifttt_failures", "IFTTT triggers that failed.", METRIC_COUNTER, &ifttt_failures },
+   {"connections_accepted", "Web connections accepted.", METRIC_COUNTER, &connections_accepted },
+   {"connections_refused", "Web connections refused because all the slots were busy.", METRIC_COUNTER, &connections_refused },
+   {"connections_reused", "Requests on connections kept open from before.", METRIC_COUNTER, &connections_reused },
+   {"connections_reclaimed", "Idle connections closed to make room for new ones.", METRIC_COUNTER, &connections_reclaimed },
+   {"events_sent", "Server-Sent Events sent to /events clients.", METRIC_COUNTER, &events_sent },
+   {"chunk_refusals", "Times the WiFi module couldn't take a chunk of a response.", METRIC_COUNTER, &chunk_refusals },
+   {"requests_limited", "Requests refused because the client made too many.", METRIC_COUNTER, &requests_limited },
+   {"requests_over_budget", "Requests refused because all the clients together made too many.", METRIC_COUNTER, &requests_over_budget },
+   {"watchdog_resets", "Watchdog resets since power on.", METRIC_COUNTER, NULL, NULL, metric_watchdog_resets },
+   {"log_entries_logged", "Log entries ever logged.", METRIC_COUNTER, NULL, NULL, metric_log_entries_logged },
+   {"log_entries", "Log entries kept now.", METRIC_GAUGE, NULL, NULL, metric_log_entries },
+   {"util_on", "Whether utility power is on.", METRIC_GAUGE, NULL, &util_on.val },
+   {"gen_on", "Whether the generator is on.", METRIC_GAUGE, NULL, &gen_on.val },
+   {"util_connected", "Whether utility power is connected to the load.", METRIC_GAUGE, NULL, &util_connected.val },
+   {"gen_connected", "Whether the generator is connected to the load.", METRIC_GAUGE, NULL, &gen_connected.val },
+   {"run_relay", "Whether the generator run relay is on.", METRIC_GAUGE, NULL, &rungenrelay },
+   {"connect_relay", "Whether the generator connect relay is on.", METRIC_GAUGE, NULL, &connectgenrelay },
+   {"athome", "Whether someone is at home.", METRIC_GAUGE, NULL, &athome },
+   {"util_volts", "Utility voltage.", METRIC_GAUGE, NULL, NULL, metric_util_volts },
+   {"gen_volts", "Generator voltage.", METRIC_GAUGE, NULL, NULL, metric_gen_volts },
+   {"load_amps{phase=\"1\"}", "Load current.", METRIC_GAUGE, NULL, NULL, metric_load_amps1 },
+   {"load_amps{phase=\"2\"}", NULL, METRIC_GAUGE, NULL, NULL, metric_load_amps2 },
+   {"battery_volts", "Battery voltage.", METRIC_GAUGE, NULL, NULL, metric_battery_volts },
+   {"battery_weak", "Whether the battery is weak.", METRIC_GAUGE, NULL, &do_battery_warning },
+   {"exercising", "Whether the generator is being exercised.", METRIC_GAUGE, NULL, &exercising },
+   {"exercise_seconds_left", "Seconds left in the exercise.", METRIC_GAUGE, NULL, NULL, metric_exercise_seconds_left },
+   {"phase_seconds", "Seconds since what the display shows began, if it's not a countdown.", METRIC_GAUGE, NULL, NULL, metric_phase_seconds },
+   {"phase_seconds_left", "Seconds left in what the display is counting down.", METRIC_GAUGE, NULL, NULL, metric_phase_seconds_left },
+   {"uptime_seconds", "Seconds since the controller started.", METRIC_GAUGE, NULL, NULL, metric_uptime_seconds },
+   {"ram_free_bytes", "Bytes between the heap and the deepest the stack has been.", METRIC_GAUGE, NULL, NULL, metric_ram_free },
+   {"connections_busy", "Web connection slots in use, besides the one answering this.", METRIC_GAUGE, NULL, NULL, metric_connections_busy } };
+#define NUM_METRICS (sizeof(metrics) / sizeof(metrics[0]))
+
+static unsigned long metric_counter(const struct metric_t *pm) { // a counter's value, for /log.bin
+   return pm->pval ? *pm->pval : (unsigned long)pm->pfunc(); }
+
+/* /log.bin is a series of sections, each a 4-character tag, a 2-byte length, and that
+   many bytes of data. All numbers are little-endian. The sections are, in this order:
+     GLOG  the format version, the sizes of a log entry, the configuration, and a time_t
+           (1 byte each), then the time of the dump, the number of the newest log entry
+           ever, and the number of the first one in LOGE (4 bytes each)
+     SITE  the TITLE of this controller, not 0-terminated
+     CONF  the config_hdr from EEPROM, as is
+     CNTR  for each counter, its 0-terminated name and a 4-byte value
+     NAME  the 0-terminated names of the event types, in order
+     LOGE  the log entries, oldest first, each a logentry_t as is
+     END.  with no data
+   A program reading it should skip sections it doesn't know, and data at the end of a section
+   that's longer than it expects, so that things can be added. */
+#define LOGBIN_VERSION 1
+
+static void bin_section(WiFiClient *pclient, const char *tag, unsigned length) { // start a section
+   byte bytes[2] = {(byte)length, (byte)(length >> 8) };
+   client_write(pclient, tag, 4, false);
+   client_write(pclient, (const char *)bytes, 2, false); }
+
+static void bin_long(WiFiClient *pclient, unsigned long val) {
+   byte bytes[4] = {(byte)val, (byte)(val >> 8), (byte)(val >> 16), (byte)(val >> 24) };
+   client_write(pclient, (const char *)bytes, 4, false); }
+
+static void json_header(WiFiClient *pclient, const char *status) { // the HTTP response header for JSON
+   client_printf(pclient, "HTTP/1.1 %s\r\n", status);
+   client_printf(pclient, "Content-Type: application/json\r\n");
+   client_printf(pclient, "Cache-Control: no-store\r\n");
+   http_header_end(pclient, -1); }
+
+/* The parts of our HTML pages that are mostly constant are described by templates. Each is a
+   list of runs of constant text, each followed by a field that is filled in from a list of
+   values, in order. Adjacent literals are joined by the compiler, which also works out their
+   lengths, and the whole thing is in flash. So sending the page is mostly copying long runs
+   of text into the buffer, with only a few fields formatted. */
+
+enum field_type_t {FIELD_NONE, FIELD_HEADER_END, FIELD_STRING, FIELD_LCD, FIELD_ETAG, FIELD_LED };
+
+struct template_t { // a run of constant text, then a field
+   const char *text;
+   unsigned short length;
+   enum field_type_t field; };
+#define TEXT(text, field) {text, sizeof(text) - 1, field }
+#define TEXT_END {NULL, 0, FIELD_NONE }
+
+struct field_t { // the value of a field (FIELD_HEADER_END doesn't have one)
+   const char *str; // for FIELD_STRING, FIELD_LCD (a display row), and FIELD_ETAG (an image ETag)
+   bool on; };      // for FIELD_LED
+
+#define OFF_COLOR "LightGray"
+#define ON_COLOR "Gold"
+
+static const struct template_t html_header_template[] = { // our standard response header for HTML requests
+   TEXT("HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/html\r\n"
+        //TEMP   "Refresh: 5\r\n" // refresh every 5 seconds
+        , FIELD_HEADER_END),
+   TEXT("<!DOCTYPE HTML>\r\n"
+        "<html><head><meta http-equiv=\"Content-Type\" content=\"text/html; charset=windows-1252\"><style>\r\n"
+        // define our CSS styles...
+        ".lcd {font-family: monospace; font-size:x-large; width:23ch; border:3px; border-style:solid; border-color:blue; border-radius:10px; padding:1em}\r\n"
+        ".led{height:20px; width:20px; border-radius:50%; background-color:blue; display:inline-block; position:absolute}\r\n"
+        ".button {height:25px; width:25px; border:2px solid red; border-radius:50%; background-color:gray; color:white; display: inline-block; position:absolute;\r\n"
+        "  -webkit-transition-duration: 0.2s; /* Safari */ transition-duration: 0.2s; cursor: pointer;}\r\n"
+        ".button:hover{background-color:red;}\r\n"
+        ".container {position: relative; text-align: left; color: white;}\r\n"
+        "</style>\r\n"
+        "<link rel=\"icon\" href=\"/favicon.ico?v=", FIELD_ETAG),  // the icon's ETag
+   TEXT("\"></head><body>\r\n"
+        "<h1>" TITLE " generator</h1>\r\n"
+        "<p style=\"font-size:large;\">&nbsp;&nbsp;&nbsp;&nbsp;", FIELD_STRING), // the date and time
+   TEXT("</p><br>\r\n", FIELD_NONE),
+   TEXT_END };
+
+static const struct template_t status_template[] = { // the display, LEDs, and buttons
+   TEXT("<p class=\"lcd\">\r\n", FIELD_LCD), // boxed fixed-width font for the display
+   TEXT("<br>\r\n", FIELD_LCD),
+   TEXT("<br>\r\n", FIELD_LCD),
+   TEXT("<br>\r\n", FIELD_LCD),
+   TEXT("<br>\r\n"
+        "</p><div class=\"container\">\r\n"
+        "<img src=\"/buttonimage.jpg?v=", FIELD_ETAG), // the button image's ETag
+   TEXT("\" width=\"350\">\r\n"
+        "<span class=\"led\" style=\"background-color:", FIELD_LED), // generator connected
+   TEXT("; left:85px; top:30px\"> </span>\r\n"
+        "<span class=\"led\" style=\"background-color:", FIELD_LED), // utility connected
+   TEXT("; left:175px; top:30px\"> </span>\r\n"
+        "<span class=\"led\" style=\"background-color:", FIELD_LED), // generator on
+   TEXT("; left:35px; top:45px\"> </span>\r\n"
+        "<span class=\"led\" style=\"background-color:", FIELD_LED), // utility on
+   TEXT("; left:225px; top:45px\"> </span>\r\n"
+        "<span class=\"led\" style=\"background-color:", FIELD_LED), // at home
+   TEXT("; left:305px; top:111px\"> </span>\r\n"
+        "<form action=\"pushbutton.html\" method=\"post\">\r\n"
+        "<button class=\"button\" style=\"left:105px; top:85px\" type=\"submit\" name=\"button\" value=\"0\"> </button>\r\n"
+        "<button class=\"button\" style=\"left:155px; top:85px\" type=\"submit\" name=\"button\" value=\"1\"> </button>\r\n"
+        "<button class=\"button\" style=\"left:32px; top:150px\" type=\"submit\" name=\"button\" value=\"2\"> </button>\r\n"
+        "<button class=\"button\" style=\"left:82px; top:150px\" type=\"submit\" name=\"button\" value=\"3\"> </button>\r\n"
+        "<button class=\"button\" style=\"left:168px; top:150px\" type=\"submit\" name=\"button\" value=\"4\"> </button>\r\n"
+        "<button class=\"button\" style=\"left:222px; top:150px\" type=\"submit\" name=\"button\" value=\"5\"> </button>\r\n"
+        "<button class=\"button\" style=\"left:301px; top:85px\" type=\"submit\" name=\"button\" value=\"6\"> </button>\r\n"
+        "</form> </div>\r\n", FIELD_NONE),
+   TEXT_END };
+
+static void client_template(WiFiClient *pclient, const struct template_t *ptemplate, const struct field_t *pfield) {
+   for (; ptemplate->text; ++ptemplate) { // send a page from its template and the values of its fields
+      client_write(pclient, ptemplate->text, ptemplate->length, true);
+      if (ptemplate->field == FIELD_NONE) continue;
+      if (ptemplate->field == FIELD_HEADER_END) {
+         http_header_end(pclient, -1);
+         continue; }
+      const char *str = pfield->str;
+      switch (ptemplate->field) {
+         case FIELD_NONE:
+         case FIELD_HEADER_END:
+            break;
+         case FIELD_LCD:
+            str = expand_arrows_and_blanks(str);
+         // fall through
+         case FIELD_STRING:
+            client_write(pclient, str, strlen(str), true);
+            break;
+         case FIELD_ETAG: // the 8 hex digits, without the quotes
+            client_write(pclient, str + 1, 8, true);
+            break;
+         case FIELD_LED:
+            if (pfield->on) client_write(pclient, ON_COLOR, sizeof(ON_COLOR) - 1, true);
+            else client_write(pclient, OFF_COLOR, sizeof(OFF_COLOR) - 1, true);
+            break; }
+      ++pfield; } }
+
+bool generate_response(WiFiClient *pclient, enum response_type_t response_type, bool keep_alive) {
+   // send a response, and return true if the connection was left open for another request
    #if HTML_SHOW_RSP
    Serial.print("---generating response type "); Serial.print(response_type);
    Serial.print(" \""); Serial.print(response_type_names[response_type]);
    Serial.print("\" at time "); Serial.println(float(millis()) / 1000);
    showing_screen = false;
    #endif
+   PROFILE_ZONE(PZ_GENERATE_RESPONSE);
+   unsigned long start_millis = millis();
+   set_activity(ACT_WEB_RESPONSE);
+   unsigned long depth = stack_depth(); // (once per response, not for every write)
+   stack_note(SP_WEB_RESPONSE, depth);
+   if (stack_web_depth) stack_note(SP_BELOW_PROCESS_WEB, depth - stack_web_depth);
+   rsp_counting = &rsp_stats[response_type];
+   ++rsp_counting->responses;
+   client_keep_alive = keep_alive;
+   client_buffer_start();
    if (response_type == RSP_FAVICON) {
-      extern char iconimagejpg[];    // binary jpg encoding of the image
-      extern int iconimagesize;   // its length
       client_printf(pclient, "HTTP/1.1 200 OK\r\n");
-      client_printf(pclient, "Content-Length:%d\r\n", iconimagesize);
-      client_printf(pclient, "Content-Type: image/jpg\r\n\r\n");
+      client_printf(pclient, "ETag: %s\r\n", image_etag(false));
+      client_printf(pclient, IMAGE_CACHE_CONTROL);
+      client_printf(pclient, "Content-Type: image/jpg\r\n");
+      http_header_end(pclient, iconimagesize);
       client_write(pclient, iconimagejpg, iconimagesize, false); }
 
    else if (response_type == RSP_BUTTONIMAGE) { // respond to the request for the button image
       /* to create the image: draw in powerpoint, save the slide as a jpeg, edit to crop and resize 50%,
          from cmd: binary_to_c buttons.jpg >buttonimage.c
          May also have to adjust width= in RSP_STATUS section. */
-      extern char buttonimagejpg[];    // binary jpg encoding of the image
-      extern int buttonimagesize;   // its length
       client_printf(pclient, "HTTP/1.1 200 OK\r\n");
-      client_printf(pclient, "Content-Length:%d\r\n", buttonimagesize);
-      client_printf(pclient, "Content-Type: image/jpg\r\n\r\n");
+      client_printf(pclient, "ETag: %s\r\n", image_etag(true));
+      client_printf(pclient, IMAGE_CACHE_CONTROL);
+      client_printf(pclient, "Content-Type: image/jpg\r\n");
+      http_header_end(pclient, buttonimagesize);
       client_write(pclient, buttonimagejpg, buttonimagesize, false); }
 
+   else if (response_type == RSP_NOTMODIFIED) { // the browser already has this version of an image
+      client_printf(pclient, "HTTP/1.1 304 Not Modified\r\n");
+      if (not_modified_etag) client_printf(pclient, "ETag: %s\r\n", not_modified_etag);
+      client_printf(pclient, IMAGE_CACHE_CONTROL);
+      http_header_end(pclient, NO_BODY); }
+
+   else if (response_type == RSP_JSON) { // the status, for programs to read
+      json_header(pclient, "200 OK");
+      update_bools();
+      json_first = true;
+      json_open(pclient, NULL, '{');
+      json_int(pclient, "time", now());
+      json_string(pclient, "datetime", format_datetime(now(), true));
+      json_string(pclient, "fatal_error", fatal_error ? fatal_msg : NULL);
+      json_bool(pclient, "util_on", util_on.val);
+      json_bool(pclient, "gen_on", gen_on.val);
+      json_bool(pclient, "util_connected", util_connected.val);
+      json_bool(pclient, "gen_connected", gen_connected.val);
+      json_bool(pclient, "run_relay", rungenrelay);
+      json_bool(pclient, "connect_relay", connectgenrelay);
+      json_bool(pclient, "athome", athome);
+      json_int(pclient, "util_volts", (long)analog(UTIL_VOLTAGE, VOLTAGE_EXAMPLE, VOLTAGE_ANALOG));
+      json_int(pclient, "gen_volts", (long)analog(GEN_VOLTAGE, VOLTAGE_EXAMPLE, VOLTAGE_ANALOG));
+      json_open(pclient, "amps", '[');
+      json_int(pclient, NULL, (long)analog(LOAD_CURRENT1, CURRENT_EXAMPLE, CURRENT_ANALOG));
+      json_int(pclient, NULL, (long)analog(LOAD_CURRENT2, CURRENT_EXAMPLE, CURRENT_ANALOG));
+      json_close(pclient, ']');
+      json_open(pclient, "battery", '{');
+      json_float(pclient, "volts", analog(BATT_VOLTAGE, BATT_EXAMPLE, BATT_ANALOG) + BATT_VOLTAGE_ADJ);
+      json_bool(pclient, "weak", do_battery_warning);
+      if (do_battery_warning) json_float(pclient, "poweroff_volts", poweroff_battery_voltage);
+      json_close(pclient, '}');
+      json_open(pclient, "exercise", '{');
+      json_bool(pclient, "exercising", exercising);
+      if (exercising)
+         json_int(pclient, "secs_left", exercise_seconds_left());
+      json_int(pclient, "last", config_hdr.exer_last);
+      if (config_hdr.exer_duration_mins > 0) json_int(pclient, "next", next_exercise_time());
+      json_close(pclient, '}');
+      if (phase_msg) { // what the display says we're waiting for, or have been doing
+         bool counting_down;
+         unsigned long secs = phase_seconds(&counting_down);
+         json_open(pclient, "phase", '{');
+         json_string(pclient, "what", phase_msg);
+         json_int(pclient, counting_down ? "secs_left" : "secs", secs);
+         json_close(pclient, '}'); }
+      json_close(pclient, '}');
+      client_printf(pclient, "\r\n"); }
+
+   else if (response_type == RSP_CONFIGJSON) { // the configuration, for programs to read and change
+      json_header(pclient, config_msg ? config_status : "200 OK");
+      json_first = true;
+      json_open(pclient, NULL, '{');
+      if (config_msg) { // after a change, what happened, then the configuration
+         json_bool(pclient, "ok", strcmp(config_status, "200 OK") == 0);
+         json_string(pclient, "msg", config_msg);
+         json_open(pclient, "config", '{'); }
+      for (unsigned ndx = 0; ndx < NUM_CONFIG_FIELDS; ++ndx) {
+         const struct config_field_t *pf = &config_fields[ndx];
+         unsigned short val = config_get(&config_hdr, pf);
+         if (pf->forever && val == FOREVER) json_string(pclient, pf->name, "forever");
+         else json_int(pclient, pf->name, val); }
+      if (config_msg) json_close(pclient, '}');
+      json_close(pclient, '}');
+      client_printf(pclient, "\r\n"); }
+
+   else if (response_type == RSP_LOGJSON) { // some of the log, for programs to collect
+      unsigned long first, last;
+      bool any = log_range(&first, &last);
+      unsigned long oldest = logfile_hdr.num_logged - logfile_hdr.num_entries + 1;
+      json_header(pclient, "200 OK");
+      json_first = true;
+      json_open(pclient, NULL, '{');
+      json_int(pclient, "oldest", oldest);
+      json_int(pclient, "newest", logfile_hdr.num_logged);
+      if (log_since >= 0 && (unsigned long)log_since + 1 < oldest) // some were overwritten before they were collected
+         json_int(pclient, "lost", oldest - log_since - 1);
+      json_open(pclient, "entries", '[');
+      if (any)
+         for (unsigned long num = first; num <= last; ++num) {
+            struct logentry_t *pe = log_entry(num);
+            char *info = log_extra_info(pe);
+            json_open(pclient, NULL, '{');
+            json_int(pclient, "num", num);
+            json_int(pclient, "time", pe->datetime);
+            json_string(pclient, "datetime", format_datetime(pe->datetime, true));
+            json_int(pclient, "type", pe->event_type);
+            json_string(pclient, "event", event_names[pe->event_type]);
+            json_string(pclient, "msg", log_msg(pe));
+            json_int(pclient, "extra_info", pe->extra_info);
+            json_string(pclient, "info", *info ? info : NULL);
+            json_close(pclient, '}'); }
+      json_close(pclient, ']');
+      json_int(pclient, "next", any ? last : log_since >= 0 ? log_since : logfile_hdr.num_logged);
+      json_bool(pclient, "more", any && last < logfile_hdr.num_logged);
+      json_close(pclient, '}');
+      client_printf(pclient, "\r\n"); }
+
+   else if (response_type == RSP_LOGCSV) { // some of the log, for spreadsheets
+      unsigned long first, last;
+      bool any = log_range(&first, &last);
+      client_printf(pclient, "HTTP/1.1 200 OK\r\n");
+      client_printf(pclient, "Content-Type: text/csv\r\n");
+      http_header_end(pclient, -1);
+      client_printf(pclient, "num,time,type,event,extra_info,msg\r\n");
+      if (any)
+         for (unsigned long num = first; num <= last; ++num) {
+            struct logentry_t *pe = log_entry(num);
+            char line[MAXLINE], *ptr = line;
+            ptr = csv_number(ptr, num);
+            ptr = csv_number(ptr, pe->datetime);
+            ptr = csv_number(ptr, pe->event_type);
+            ptr = csv_string(ptr, event_names[pe->event_type], MAXLINE / 4);
+            ptr = csv_number(ptr, pe->extra_info);
+            ptr = csv_string(ptr, pe->msg, LOG_MSGSIZE);
+            ptr[-1] = '\r'; // (instead of the last comma)
+            *ptr++ = '\n';
+            client_write(pclient, line, ptr - line, true); } }
+
+   else if (response_type == RSP_LOGBIN) { // some of the log and more, for the logdecode program
+      unsigned long first, last;
+      bool any = log_range(&first, &last);
+      unsigned length = 0;
+      client_printf(pclient, "HTTP/1.1 200 OK\r\n");
+      client_printf(pclient, "Content-Type: application/octet-stream\r\n");
+      client_printf(pclient, "Content-Disposition: attachment; filename=\"log.bin\"\r\n");
+      http_header_end(pclient, -1);
+      bin_section(pclient, "GLOG", 16);
+      byte sizes[4] = {LOGBIN_VERSION, sizeof(struct logentry_t), sizeof(config_hdr), sizeof(time_t) };
+      client_write(pclient, (const char *)sizes, 4, false);
+      bin_long(pclient, now());
+      bin_long(pclient, logfile_hdr.num_logged);
+      bin_long(pclient, any ? first : 0);
+      bin_section(pclient, "SITE", strlen(TITLE));
+      client_write(pclient, TITLE, strlen(TITLE), false);
+      bin_section(pclient, "CONF", sizeof(config_hdr));
+      client_write(pclient, (const char *)&config_hdr, sizeof(config_hdr), false);
+      for (unsigned ndx = 0; ndx < NUM_METRICS; ++ndx)
+         if (metrics[ndx].type == METRIC_COUNTER) length += strlen(metrics[ndx].name) + 1 + 4;
+      bin_section(pclient, "CNTR", length);
+      for (unsigned ndx = 0; ndx < NUM_METRICS; ++ndx)
+         if (metrics[ndx].type == METRIC_COUNTER) {
+            client_write(pclient, metrics[ndx].name, strlen(metrics[ndx].name) + 1, false);
+            bin_long(pclient, metric_counter(&metrics[ndx])); }
+      length = 0;
+      for (int type = 0; type < EV_NUM_EVENTS; ++type) length += strlen(event_names[type]) + 1;
+      bin_section(pclient, "NAME", length);
+      for (int type = 0; type < EV_NUM_EVENTS; ++type)
+         client_write(pclient, event_names[type], strlen(event_names[type]) + 1, false);
+      bin_section(pclient, "LOGE", any ? (last - first + 1) * sizeof(struct logentry_t) : 0);
+      if (any)
+         for (unsigned long num = first; num <= last; ++num)
+            client_write(pclient, (const char *)log_entry(num), sizeof(struct logentry_t), false);
+      bin_section(pclient, "END.", 0); }
+
+   else if (response_type == RSP_TRACE) { // the input trace, as a simulator script
+      client_printf(pclient, "HTTP/1.1 200 OK\r\n");
+      client_printf(pclient, "Content-Type: text/plain\r\n");
+      http_header_end(pclient, -1);
+      trace_script(client_print_line, pclient); }
+
+   else if (response_type == RSP_METRICS) { // the counters and gauges, for Prometheus
+      client_printf(pclient, "HTTP/1.1 200 OK\r\n");
+      client_printf(pclient, "Content-Type: text/plain; version=0.0.4\r\n");
+      client_printf(pclient, "Cache-Control: no-store\r\n");
+      http_header_end(pclient, -1);
+      update_bools();
+      for (unsigned ndx = 0; ndx < NUM_METRICS; ++ndx) {
+         const struct metric_t *pm = &metrics[ndx];
+         const char *suffix = pm->type == METRIC_COUNTER ? "_total" : "";
+         int length = strcspn(pm->name, "{"); // (without the label)
+         if (pm->help) {
+            client_printf(pclient, "# HELP generator_%.*s%s %s\n", length, pm->name, suffix, pm->help);
+            client_printf(pclient, "# TYPE generator_%.*s%s %s\n", length, pm->name, suffix,
+                          pm->type == METRIC_COUNTER ? "counter" : "gauge"); }
+         client_printf(pclient, "generator_%.*s%s%s ", length, pm->name, suffix, pm->name + length);
+         if (pm->type == METRIC_COUNTER) client_printf(pclient, "%lu\n", metric_counter(pm));
+         else if (pm->pval) client_printf(pclient, "%ld\n", *pm->pval);
+         else if (pm->pbool) client_printf(pclient, "%d\n", *pm->pbool ? 1 : 0);
+         else {
+            float val = pm->pfunc();
+            if (val == (long)val) client_printf(pclient, "%ld\n", (long)val);
+            else client_printf(pclient, "%.2f\n", val); } } }
+
    else  { // for everything else
       // start by sending our standard http response header, which includes the title and date/time
-      const char *response_header[] = { // our standard response header for HTML requests
-         "HTTP/1.1 200 OK\r\n",
-         "Content-Type: text/html\r\n",
-         "Connection: close\r\n",
-         //TEMP   "Refresh: 5\r\n", // refresh every 5 seconds
-         "\r\n",
-         "<!DOCTYPE HTML>\r\n",
-         "<html><head><meta http-equiv=\"Content-Type\" content=\"text/html; charset=windows-1252\"><style>\r\n",
-         // define our CSS styles...
-         ".lcd {font-family: monospace; font-size:x-large; width:23ch; border:3px; border-style:solid; border-color:blue; border-radius:10px; padding:1em}\r\n",
-         ".led{height:20px; width:20px; border-radius:50%; background-color:blue; display:inline-block; position:absolute}\r\n",
-         ".button {height:25px; width:25px; border:2px solid red; border-radius:50%; background-color:gray; color:white; display: inline-block; position:absolute;\r\n",
-         "  -webkit-transition-duration: 0.2s; /* Safari */ transition-duration: 0.2s; cursor: pointer;}\r\n",
-         ".button:hover{background-color:red;}\r\n",
-         ".container {position: relative; text-align: left; color: white;}\r\n",
-         "</style></head><body>\r\n",
-         "<h1>" TITLE " generator</h1>\r\n",
-         0 };
-      for (const char **ptr = response_header; *ptr; ++ptr)
-         client_write(pclient, *ptr, strlen(*ptr), true);
-      client_printf(pclient, "<p style=\"font-size:large;\">&nbsp;&nbsp;&nbsp;&nbsp;%s</p><br>\r\n", format_datetime(now(), true));
+      const struct field_t header_fields[] = {{image_etag(false) }, {format_datetime(now(), true) } };
+      client_template(pclient, html_header_template, header_fields);
 
       if (response_type == RSP_STATUS) {
          if (fatal_error) {
             client_printf(pclient, "FATAL ERROR: %s<br>\r\n ", fatal_msg); }
          else {
-            client_printf(pclient, "<p class=\"lcd\">\r\n"); // boxed fixed-width font for LCD
-            for (int row = 0; row < 4; ++row) { // show contents of the LCD display
-               client_printf(pclient, expand_arrows_and_blanks(lcdbuf[row]));
-               client_printf(pclient, "<br>\r\n"); }
-            client_printf(pclient, "</p><div class=\"container\">\r\n");
-            client_printf(pclient, "<img src=\"/buttonimage.jpg\" width=\"350\">\r\n");
             update_bools();
-#define OFF_COLOR "LightGray"
-#define ON_COLOR "Gold"
-            client_printf(pclient, "<span class=\"led\" style=\"background-color:%s; left:85px; top:30px\"> </span>\r\n",
-                          gen_connected.val ? ON_COLOR : OFF_COLOR);
-            client_printf(pclient, "<span class=\"led\" style=\"background-color:%s; left:175px; top:30px\"> </span>\r\n",
-                          util_connected.val ? ON_COLOR : OFF_COLOR);
-            client_printf(pclient, "<span class=\"led\" style=\"background-color:%s; left:35px; top:45px\"> </span>\r\n",
-                          gen_on.val ? ON_COLOR : OFF_COLOR);
-            client_printf(pclient, "<span class=\"led\" style=\"background-color:%s; left:225px; top:45px\"> </span>\r\n",
-                          util_on.val ? ON_COLOR : OFF_COLOR);
-            client_printf(pclient, "<span class=\"led\" style=\"background-color:%s; left:305px; top:111px\"> </span>\r\n",
-                          athome ? ON_COLOR : OFF_COLOR);
-            client_printf(pclient, "<form action=\"pushbutton.html\" method=\"post\">\r\n");
-            client_printf(pclient, "<button class=\"button\" style=\"left:105px; top:85px\" type=\"submit\" name=\"button\" value=\"0\"> </button>\r\n");
-            client_printf(pclient, "<button class=\"button\" style=\"left:155px; top:85px\" type=\"submit\" name=\"button\" value=\"1\"> </button>\r\n");
-            client_printf(pclient, "<button class=\"button\" style=\"left:32px; top:150px\" type=\"submit\" name=\"button\" value=\"2\"> </button>\r\n");
-            client_printf(pclient, "<button class=\"button\" style=\"left:82px; top:150px\" type=\"submit\" name=\"button\" value=\"3\"> </button>\r\n");
-            client_printf(pclient, "<button class=\"button\" style=\"left:168px; top:150px\" type=\"submit\" name=\"button\" value=\"4\"> </button>\r\n");
-            client_printf(pclient, "<button class=\"button\" style=\"left:222px; top:150px\" type=\"submit\" name=\"button\" value=\"5\"> </button>\r\n");
-            client_printf(pclient, "<button class=\"button\" style=\"left:301px; top:85px\" type=\"submit\" name=\"button\" value=\"6\"> </button>\r\n");
-            client_printf(pclient, "</form> </div>\r\n"); } }
+            const struct field_t status_fields[] = {
+               {lcdbuf[0] }, {lcdbuf[1] }, {lcdbuf[2] }, {lcdbuf[3] }, {image_etag(true) },
+               {NULL, gen_connected.val }, {NULL, util_connected.val }, {NULL, gen_on.val }, {NULL, util_on.val },
+               {NULL, athome } };
+            client_template(pclient, status_template, status_fields); } }
 
       else if (response_type == RSP_LOG) {
-         client_printf(pclient, "<p style=\"font-size:medium;\">%d log file entries<br>\r\n", logfile_hdr.num_entries);
+         unsigned long first, last;
+         bool any = log_range(&first, &last);
+         client_printf(pclient, "<p style=\"font-size:medium;\">%d log file entries", logfile_hdr.num_entries);
          if (logfile_hdr.num_entries > 0)
-            for (int ndx = logfile_hdr.newest; ;) {
-               client_printf(pclient, "%s  %s<br>\r\n",
-                             format_datetime(logfile[ndx].datetime, true),
-                             event_names[logfile[ndx].event_type]);
-               if (ndx == logfile_hdr.oldest) break;
-               if (--ndx < 0) ndx = log_max_entries - 1; }
+            client_printf(pclient, ", numbered %lu to %lu", logfile_hdr.num_logged - logfile_hdr.num_entries + 1,
+                          logfile_hdr.num_logged);
+         client_printf(pclient, "<br>\r\n");
+         if (any)
+            for (unsigned long num = last; num >= first; --num) { // newest first
+               struct logentry_t *pe = log_entry(num);
+               char *msg = log_msg(pe), *info = log_extra_info(pe);
+               client_printf(pclient, "%lu: %s  %s", num, format_datetime(pe->datetime, true), event_names[pe->event_type]);
+               if (msg) {
+                  client_printf(pclient, ", ");
+                  client_html(pclient, msg); }
+               client_printf(pclient, "%s%s<br>\r\n", *info ? ", " : "", info); }
+         if (any && last < logfile_hdr.num_logged)
+            client_printf(pclient, "<a href=\"/log?since=%lu&limit=%d\">newer entries</a><br>\r\n", last, log_limit);
          client_printf(pclient, "</p>\r\n"); }
 
       else if (response_type == RSP_VISITORS) {
          client_printf(pclient, "<p style=\"font-size:medium;\">%d total requests processed<br><br>\r\n",
                        requests_processed);
-         sort_clients();
-         for (int ndx = 0; ndx < MAX_IP_ADDRESSES; ++ndx)
+         for (int ndx = newest_client; ndx >= 0; ndx = clients[ndx].older)
             if (clients[ndx].count > 0) {
                client_printf(pclient, "IP %s visited %d times, first at %s",
                              format_ip_address(clients[ndx].ip_address),
@@ -396,6 +1626,110 @@ void generate_response(WiFiClient *pclient, enum response_type_t response_type)
                client_printf(pclient, "%s<br>\r\n",
                              clients[ndx].gave_password ? "; password given" : ""); } }
 
+      else if (response_type == RSP_STATS) {
+         client_printf(pclient, "<p style=\"font-size:medium;\">since startup at %s<br><br>\r\n",
+                       format_datetime(startup_datetime, true));
+         client_printf(pclient, "web responses:<br>\r\n");
+         for (int ndx = 0; ndx < RSP_NONE; ++ndx) {
+            struct rsp_stats_t *ps = &rsp_stats[ndx];
+            if (ps->responses > 0)
+               client_printf(pclient, "%s: %ld, averaging %ld bytes in %ld writes and %lu msec; max %lu msec<br>\r\n",
+                             response_type_names[ndx], ps->responses, ps->bytes / ps->responses,
+                             ps->writes / ps->responses, ps->msecs / ps->responses, ps->max_msecs); }
+         int watching = 0;
+         for (int ndx = 0; ndx < MAX_CONNECTIONS; ++ndx)
+            if (connections[ndx].state == CONN_EVENTS) ++watching;
+         client_printf(pclient, "connections: %ld accepted, %ld refused because all %d slots were busy; at most %d at once<br>\r\n",
+                       connections_accepted, connections_refused, MAX_CONNECTIONS, connections_max_busy);
+         client_printf(pclient, "%ld requests on connections kept open for them; %ld idle connections closed for new ones<br>\r\n",
+                       connections_reused, connections_reclaimed);
+         client_printf(pclient, "%ld requests refused because a client made too many, %ld because everyone did<br>\r\n",
+                       requests_limited, requests_over_budget);
+         client_printf(pclient, "%ld events sent; %d watching<br>\r\n", events_sent, watching);
+         client_printf(pclient, "sent to the WiFi module in chunks of %d bytes, %d msec apart; %ld chunks refused<br>\r\n",
+                       chunk_size, chunk_delay_msec, chunk_refusals);
+         if (parse_stats.requests > 0)
+            client_printf(pclient, "requests read: %ld, averaging %ld bytes in %ld lines; max %lu bytes, %lu msec<br>\r\n",
+                          parse_stats.requests, parse_stats.bytes / parse_stats.requests,
+                          parse_stats.lines / parse_stats.requests, parse_stats.max_bytes, parse_stats.max_msecs);
+         client_printf(pclient, "requests rejected: %ld with too many lines, %ld too big, %ld too slow; %ld lines truncated<br>\r\n",
+                       parse_stats.too_many_lines, parse_stats.too_many_bytes, parse_stats.too_slow, parse_stats.long_lines);
+         client_printf(pclient, "<br>EEPROM: %lu bytes written, %lu changed<br>\r\n",
+                       eeprom_bytes_requested, eeprom_bytes_changed);
+         for (const struct eeprom_region_t *pr = eeprom_regions; pr->name; ++pr) {
+            unsigned long changes = 0;
+            int hottest = pr->start;
+            for (int addr = pr->start; addr < pr->end; ++addr) {
+               changes += eeprom_changes[addr];
+               if (eeprom_changes[addr] > eeprom_changes[hottest]) hottest = addr; }
+            client_printf(pclient, "%s: %lu changes, most at address %d (%u times)<br>\r\n",
+                          pr->name, changes, hottest, eeprom_changes[hottest]); }
+         float years = eeprom_years_left();
+         if (years >= 0)
+            client_printf(pclient, "at this rate the EEPROM will wear out in %.0f years<br>\r\n", years);
+         show_timing(pclient, "<br>time between calls to idle()", &idle_intervals);
+         show_timing(pclient, "loop() iterations", &loop_times);
+         client_printf(pclient, "%lu stalls of %d msec or more; the watchdog resets at %d sec<br>\r\n",
+                       num_stalls, STALL_MSEC, WATCHDOG_SECS);
+         for (unsigned long count = 0; count < num_stalls && count < NUM_STALLS; ++count) {
+            struct stall_t *ps = &stalls[(num_stalls - 1 - count) % NUM_STALLS]; // newest first
+            client_printf(pclient, "%s: %lu msec during %s, web %s, before idle() from %p<br>\r\n",
+                          format_datetime(ps->datetime, true), ps->msec, activity_names[ps->activity],
+                          web_status_names[ps->web_status], ps->caller); }
+         if (WATCHDOG) {
+            client_printf(pclient, "longest time between watchdog refreshes: %lu msec during %s since startup",
+                          watchdog_max_msec, activity_names[watchdog_max_activity]);
+            if (config_hdr.watchdog_max_msec > 0)
+               client_printf(pclient, ", %u msec during %s ever",
+                             config_hdr.watchdog_max_msec, activity_names[config_hdr.watchdog_max_activity]);
+            client_printf(pclient, "<br>\r\n");
+            if (config_hdr.watchdog_reset_activity > 0)
+               client_printf(pclient, "the last watchdog reset was during %s<br>\r\n",
+                             activity_names[config_hdr.watchdog_reset_activity - 1]); }
+         client_printf(pclient, "<br>RAM: %lu bytes free, with the stack using at most %lu bytes; "
+                       "the log takes %u bytes, the visitors %u bytes, and a line buffer %d bytes<br>\r\n",
+                       ram_free(), stack_max_used(), log_max_entries * sizeof(struct logentry_t),
+                       sizeof(clients) + sizeof(client_hash), MAXLINE);
+         client_printf(pclient, "deepest stack in bytes:");
+         for (int point = 0; point < SP_NUM_POINTS; ++point)
+            client_printf(pclient, "%s %s %lu", point ? "," : "", stack_point_names[point], stack_max_depth[point]);
+         client_printf(pclient, "; an assertion failure during a web request could take %lu<br>\r\n",
+                       stack_max_depth[SP_ASSERT] + stack_max_depth[SP_BELOW_PROCESS_WEB]);
+         client_printf(pclient, "</p>\r\n"); }
+
+      else if (response_type == RSP_PROFILE) {
+         #if PROFILE
+         client_printf(pclient, "<p style=\"font-size:medium;\">CPU cycles at %lu MHz since startup at %s<br><br>\r\n",
+                       F_CPU / 1000000, format_datetime(startup_datetime, true));
+         for (int zone = 0; zone < PZ_NUM_ZONES; ++zone) {
+            struct profile_stats_t *ps = &profile_stats[zone];
+            if (ps->calls > 0) {
+               unsigned long avg_cycles = ps->total_cycles / ps->calls;
+               client_printf(pclient, "%s: %lu calls, min %lu, avg %lu, max %lu cycles; avg %.1f usec<br>\r\n",
+                             profile_zone_names[zone], ps->calls, ps->min_cycles, avg_cycles, ps->max_cycles,
+                             (float)avg_cycles / (F_CPU / 1000000)); }
+            else client_printf(pclient, "%s: no calls<br>\r\n", profile_zone_names[zone]); }
+         client_printf(pclient, "</p>\r\n");
+         #else
+         client_printf(pclient, "<p style=\"font-size:medium;\">profiling is not compiled in; set PROFILE in generator.h</p>\r\n");
+         #endif
+      }
+
+      else if (response_type == RSP_CONFIG) { // a form to change the configuration
+         client_printf(pclient, "<div style=\"font-size:medium;\">\r\n");
+         if (config_msg) client_printf(pclient, "<p><b>%s</b></p>\r\n", config_msg);
+         client_printf(pclient, "<form action=\"config.html\" method=\"post\"><table>\r\n");
+         for (unsigned ndx = 0; ndx < NUM_CONFIG_FIELDS; ++ndx) {
+            const struct config_field_t *pf = &config_fields[ndx];
+            unsigned short val = config_get(&config_hdr, pf);
+            client_printf(pclient, "<tr><td>%s</td><td><input type=\"text\" name=\"%s\" size=\"7\" value=\"", pf->name, pf->name);
+            if (pf->forever && val == FOREVER) client_printf(pclient, "forever");
+            else client_printf(pclient, "%u", val);
+            client_printf(pclient, "\"></td><td>%u to %u%s</td></tr>\r\n", pf->min, pf->max, pf->forever ? ", or forever" : ""); }
+         client_printf(pclient, "<tr><td>password</td><td><input type=\"password\" name=\"pwd\" size=\"7\"></td>"
+                       "<td>needed for each change</td></tr>\r\n");
+         client_printf(pclient, "</table><input type=\"submit\" value=\"change\"></form></div>\r\n"); }
+
       else if (response_type == RSP_ASKPASS) {
          client_printf(pclient, "<form action=\"setpass.html\" method=\"post\">\r\n");
          client_printf(pclient, "password: <input type=\"password\" name=\"pwd\" minlength=\"3\"><br>\r\n");
@@ -407,90 +1741,768 @@ void generate_response(WiFiClient *pclient, enum response_type_t response_type)
 
       client_printf(pclient, "</body></html>\r\n"); }
 
-   delay(10);
+   bool kept = client_flush(pclient) && client_keep_alive;
+   if (!kept) {
+      delay(10);
+      #if HTML_SHOW_RSP
+      Serial.println("closing client connection from generate_response()...");
+      showing_screen = false;
+      #endif
+      while (pclient->connected() && pclient->available() > 0) pclient->read(); // make sure input is empty
+      delay(10);
+      if (pclient->connected()) pclient->stop(); } // stop the TCP connection
+   //delete pclient;
+   unsigned long elapsed_millis = millis() - start_millis;
+   rsp_counting->msecs += elapsed_millis;
+   if (elapsed_millis > rsp_counting->max_msecs) rsp_counting->max_msecs = elapsed_millis;
+   rsp_counting = NULL;
+   web_status = WEB_AWAITING_CLIENT;
+   return kept; }
+
+static bool bucket_take(struct bucket_t *pb, unsigned short size, unsigned long refill_msec) {
+   // take a token from a bucket that holds size of them and gets one every refill_msec, if it has one
+   unsigned long elapsed = millis() - pb->refill_millis;
+   if (elapsed >= refill_msec) {
+      unsigned long tokens = elapsed / refill_msec;
+      if (pb->tokens + tokens >= size) {
+         pb->tokens = size;
+         pb->refill_millis = millis(); }
+      else {
+         pb->tokens += tokens;
+         pb->refill_millis += tokens * refill_msec; } }
+   if (pb->tokens == 0) return false;
+   --pb->tokens;
+   return true; }
+
+static bool admit_request(struct client_t *visitor) { // may we answer this request now?
+   if (!web_limits) return true;
+   if (!bucket_take(&visitor->bucket, CLIENT_BURST, CLIENT_REQUEST_MSEC)) {
+      ++requests_limited;
+      return false; }
+   if (!bucket_take(&web_budget, WEB_BURST, WEB_REQUEST_MSEC) && !visitor->gave_password) {
+      ++visitor->bucket.tokens; // (it keeps the one it didn't get to use)
+      ++requests_over_budget;
+      return false; }
+   return true; }
+
+static void client_refuse(WiFiClient *pclient, const char *status) { // a short response that closes the connection
+   client_buffer_start();
+   client_printf(pclient, "HTTP/1.1 %s\r\n", status);
+   client_printf(pclient, "Retry-After: 2\r\n");
+   client_printf(pclient, "Content-Length: 0\r\n");
+   client_printf(pclient, "Connection: close\r\n\r\n");
+   client_flush(pclient);
+   pclient->stop(); }
+
+#if SIMULATE
+// A client that accepts and discards whatever we write, so that the generation of all
+// the web pages can be timed without a network. See the "bench" command in gensimulate.cpp.
+class bench_client_t : public WiFiClient {
+   public:
+      size_t write(const uint8_t *buf, size_t size) {
+         return size; }
+      uint8_t connected(void) {
+         return true; }
+      int available(void) {
+         return 0; }
+      int read(void) {
+         return -1; }
+      void stop(void) { } };
+
+void web_benchmark(int repeats) { // generate each type of response and report what it took
+   bench_client_t bench_client;
+   struct rsp_stats_t saved_stats[RSP_NONE];
+   enum web_status_t saved_web_status = web_status;
+   memcpy(saved_stats, rsp_stats, sizeof(rsp_stats));
+   memset(rsp_stats, 0, sizeof(rsp_stats));
+   Serial.print("web benchmark, compiled " __DATE__ " " __TIME__ ", ");
+   Serial.print(repeats); Serial.println(" of each response");
+   long total_bytes = 0, total_writes = 0;
+   float total_msecs = 0;
+   char string[MAXLINE];
+   for (int type = RSP_STATUS; type < RSP_NONE; ++type) {
+      for (int count = 0; count < repeats; ++count)
+         generate_response(&bench_client, (enum response_type_t) type, false);
+      struct rsp_stats_t *ps = &rsp_stats[type];
+      sprintf(string, "  %-12s %6ld bytes %4ld writes %7.1f msec", response_type_names[type],
+              ps->bytes / repeats, ps->writes / repeats, (float)ps->msecs / repeats);
+      Serial.println(string);
+      total_bytes += ps->bytes / repeats;
+      total_writes += ps->writes / repeats;
+      total_msecs += (float)ps->msecs / repeats; }
+   // one line to compare with other builds, with the settings that most affect it
+   sprintf(string, "bench totals: %ld bytes, %ld writes, %.1f msec; %d responses, %d-byte buffer, %d-byte chunks",
+           total_bytes, total_writes, total_msecs, RSP_NONE - RSP_STATUS, CLIENT_BUFFER_SIZE, CHUNK_MAX);
+   Serial.println(string);
+   memcpy(rsp_stats, saved_stats, sizeof(rsp_stats));
+   web_status = saved_web_status;
+   showing_screen = false; }
+#endif
+
+#if SIMULATE
+// A client that sends a generated request, maybe slowly, maybe forever, maybe never finishing,
+// so that the request parser can be fed whatever a broken or hostile client might send.
+// Each kind of request is checked: valid ones must never be rejected, hostile ones always
+// must be, none may take more bytes or time than the limits allow, no call of the parser may
+// hold up the control loop for long, and the line buffer must never be overrun.
+// See the "fuzz" command in gensimulate.cpp.
+#define FUZZ_CALL_MSEC 20   // the longest one call of request_read() may take, in real time
+#define FUZZ_SLACK_MSEC 50  // how far past MAX_REQUEST_MSEC a request may end
+static unsigned long fuzz_seed = 1;
+
+static unsigned fuzz_random(unsigned limit) { // a repeatable pseudo-random number from 0 to limit-1
+   fuzz_seed = fuzz_seed * 1103515245 + 12345;
+   return (fuzz_seed >> 16) % limit; }
+
+class fuzz_client_t : public WiFiClient {
+   public:
+      const char *data;          // what we send, or random bytes without newlines if NULL
+      unsigned long length, sent;
+      unsigned long drip_msec;   // the time between bytes, for a slow client
+      unsigned long next_millis;
+      bool hang;                 // stay connected after sending it all?
+      size_t write(const uint8_t *buf, size_t size) {
+         return size; }
+      uint8_t connected(void) {
+         return sent < length || hang; }
+      int available(void) {
+         return sent < length && (long)(millis() - next_millis) >= 0 ? 1 : 0; }
+      int read(void) {
+         if (sent >= length) return -1;
+         next_millis = millis() + drip_msec;
+         if (data) return (byte)data[sent++];
+         ++sent;
+         int ch = fuzz_random(256);
+         return ch == '\n' ? 'x' : ch; }
+      void stop(void) { } };
+
+enum fuzz_rejects_t {FUZZ_NEVER, FUZZ_MAYBE, FUZZ_ALWAYS }; // which requests the parser must reject
+static const struct fuzz_case_t {
+   const char *name;
+   enum fuzz_rejects_t rejects; }
+fuzz_cases[] = {
+   {"valid GET", FUZZ_NEVER }, {"POST button", FUZZ_NEVER }, {"garbage", FUZZ_MAYBE },
+   {"binary", FUZZ_MAYBE }, {"long line", FUZZ_MAYBE }, {"many lines", FUZZ_ALWAYS },
+   {"truncated", FUZZ_MAYBE }, {"slow drip", FUZZ_ALWAYS }, {"endless", FUZZ_ALWAYS },
+   {"stalled", FUZZ_MAYBE } };
+#define FUZZ_CASES (sizeof(fuzz_cases) / sizeof(fuzz_cases[0]))
+
+static char fuzz_data[MAX_REQUEST_BYTES];
+
+static unsigned long read_request(WiFiClient *pclient, struct web_request_t *preq) {
+   // read a request, waiting for all of it; return the longest any call took, in real usec
+   unsigned long max_usec = 0;
+   request_start(preq);
+   while (1) {
+      unsigned long start_usec = micros();
+      bool done = request_read(pclient, preq);
+      if (micros() - start_usec > max_usec) max_usec = micros() - start_usec;
+      if (done) return max_usec;
+      delay(1); } }
+
+static void fuzz_make(unsigned type, fuzz_client_t *pclient) { // generate a request of this type
+   static const char *pages[] = {"/", "/log", "/visitors", "/stats", "/favicon.ico", "/nosuchpage" };
+   int length = 0;
+   pclient->data = fuzz_data;
+   pclient->sent = pclient->drip_msec = 0;
+   pclient->next_millis = millis();
+   pclient->hang = false;
+   switch (type) {
+      case 0: // a valid request for a page
+      case 6: // which gets cut off somewhere
+      case 7: // or comes a byte every 300 msec
+      case 9: // or stalls before the blank line, but stays connected
+         length = sprintf(fuzz_data, "GET %s HTTP/1.1\r\nHost: 192.168.1.2\r\nUser-Agent: fuzz\r\n%s",
+                          pages[fuzz_random(sizeof(pages) / sizeof(pages[0]))], type == 9 ? "" : "\r\n");
+         if (type == 6) length = fuzz_random(length);
+         if (type == 7) pclient->drip_msec = 300;
+         if (type == 9) pclient->hang = true;
+         break;
+      case 1: // a button push, maybe with an outrageous button number
+         length = sprintf(fuzz_data, "POST /pushbutton.html HTTP/1.1\r\nContent-Length: 8\r\n\r\nbutton=%d",
+                          (int)fuzz_random(20) - 5 + (fuzz_random(10) == 0 ? 99999999 : 0));
+         break;
+      case 2: // lines of printable garbage
+         for (int lines = fuzz_random(10); lines > 0; --lines) {
+            for (int chars = fuzz_random(100); chars > 0; --chars)
+               fuzz_data[length++] = ' ' + fuzz_random(95);
+            length += sprintf(fuzz_data + length, "\r\n"); }
+         length += sprintf(fuzz_data + length, "\r\n");
+         break;
+      case 3: // any bytes at all, including NULs
+         length = fuzz_random(1000);
+         for (int ndx = 0; ndx < length; ++ndx) fuzz_data[ndx] = fuzz_random(256);
+         break;
+      case 4: // a line much longer than our buffer
+         length = sprintf(fuzz_data, "GET /");
+         while (length < 3000) fuzz_data[length++] = 'A' + fuzz_random(26);
+         length += sprintf(fuzz_data + length, " HTTP/1.1\r\n\r\n");
+         break;
+      case 5: // too many header lines
+         length = sprintf(fuzz_data, "GET / HTTP/1.1\r\n");
+         for (int line = 0; line < 200; ++line)
+            length += sprintf(fuzz_data + length, "X-Header-%d: %u\r\n", line, fuzz_random(1000));
+         length += sprintf(fuzz_data + length, "\r\n");
+         break;
+      case 8: // bytes forever, with no newline
+         pclient->data = NULL;
+         length = 0xffffffff;
+         break; }
+   pclient->length = length; }
+
+void web_fuzz(int count) { // feed generated requests to the request parser, and report and check what it did
+   fuzz_client_t fuzz_client;
+   struct web_request_t request;
+   struct parse_stats_t saved_stats = parse_stats;
+   int passed = 0, failed = 0;
+   fuzz_seed = 1;
+   Serial.print("web request fuzzing, compiled " __DATE__ " " __TIME__ ", ");
+   Serial.print(count); Serial.println(" of each kind of request");
+   for (unsigned type = 0; type < FUZZ_CASES; ++type) {
+      unsigned long max_bytes = 0, max_msecs = 0, max_call_usec = 0, rejected = 0;
+      bool overrun = false;
+      unsigned long start_usec = micros();
+      for (int num = 0; num < count; ++num) {
+         if (WATCHDOG) watchdog_poke();
+         fuzz_make(type, &fuzz_client);
+         unsigned long start_millis = millis();
+         unsigned long call_usec = read_request(&fuzz_client, &request);
+         unsigned long elapsed_millis = millis() - start_millis;
+         if (request.bytes > max_bytes) max_bytes = request.bytes;
+         if (elapsed_millis > max_msecs) max_msecs = elapsed_millis;
+         if (call_usec > max_call_usec) max_call_usec = call_usec;
+         if (request.rejected) ++rejected;
+         if (memchr(request.line, 0, MAXLINE) == NULL) overrun = true; }
+      unsigned long usec = micros() - start_usec;
+      const char *problem = // (the byte that goes over MAX_REQUEST_BYTES is counted)
+         fuzz_cases[type].rejects == FUZZ_NEVER && rejected > 0 ? "valid requests were rejected"
+         : fuzz_cases[type].rejects == FUZZ_ALWAYS && rejected < (unsigned long)count ? "hostile requests were accepted"
+         : max_bytes > MAX_REQUEST_BYTES + 1 ? "too many bytes were read"
+         : max_msecs > MAX_REQUEST_MSEC + FUZZ_SLACK_MSEC ? "a request took too long"
+         : max_call_usec > FUZZ_CALL_MSEC * 1000UL ? "a call of the parser took too long"
+         : overrun ? "the line buffer was overrun" : NULL;
+      if (problem) ++failed;
+      else ++passed;
+      char string[MAXLINE];
+      sprintf(string, "  %-12s %7.0f requests/sec, max %5lu bytes %5lu msec, longest call %5lu usec, %4lu rejected%s%s",
+              fuzz_cases[type].name, usec ? count * 1e6 / usec : 0.0, max_bytes, max_msecs, max_call_usec, rejected,
+              problem ? ": FAILED, " : "", problem ? problem : "");
+      Serial.println(string); }
+   Serial.print("fuzz checks: "); Serial.print(passed); Serial.print(" passed, ");
+   Serial.print(failed); Serial.println(" failed");
+   parse_stats = saved_stats;
+   showing_screen = false; }
+
+// Flood the server with requests for the status page from three made-up clients: a greedy one
+// that takes every slot it can and sends as many requests as it may on each connection without
+// waiting for the answers, a scanner that uses a new address each time, and a browser that gave
+// the password and asks every couple of seconds. They connect through accept_client() in place
+// of the WiFi module's clients, one new connection per call, and are served by the real
+// process_web() from idle(), which the control loop calls every FLOOD_TURN_MSEC in real time.
+// We show the times between the calls of idle(), from the idle_intervals histogram, and what
+// each client got, without and then with the admission control. Then we check that with it,
+// the control loop was never held up for long, the browser was always answered and didn't
+// wait longer, and the scanner was limited. See the "flood" command in gensimulate.cpp.
+#define FLOOD_SOCKETS 12        // how many connections the made-up clients can have open
+#define FLOOD_SOCKET_BASE 100   // their socket numbers, which aren't the module's
+#define FLOOD_TURN_MSEC 10      // how often the control loop calls idle()
+#define FLOOD_BROWSER_MSEC 2000 // how often the browser asks for the page
+#define FLOOD_WAIT_SECS 10      // how long we wait for the web server to be ready
+#define FLOOD_IDLE_MSEC 250     // the longest time between calls to idle() we allow with the limits
+
+enum flood_who_t {FLOOD_GREEDY, FLOOD_SCANNER, FLOOD_BROWSER, FLOOD_CLIENTS };
+static const char *flood_client_names[] = {"greedy", "scanner", "browser" };
+
+static struct { // what each client got
+   long answered, limited, busy;   // the 200s, 429s, and 503s
+   unsigned long max_wait_msec; }  // the longest it waited for a 200
+flood_got[FLOOD_CLIENTS];
+static bool flooding = false;      // do the made-up clients take the place of the module's?
+
+class flood_client_t : public WiFiClient {
+   public:
+      bool open;
+      byte who;
+      IPAddress addr;
+      const char *request;          // what it sends, some number of times
+      unsigned long request_length, length, sent;
+      unsigned long asked_millis;   // when it started waiting for the next response
+      void start(int sock, byte client, IPAddress address, const char *req, int repeats) {
+         WiFiClient::operator=(WiFiClient(FLOOD_SOCKET_BASE + sock));
+         open = true;
+         who = client;
+         addr = address;
+         request = req;
+         request_length = strlen(req);
+         length = request_length * repeats;
+         sent = 0;
+         asked_millis = millis(); }
+      size_t write(const uint8_t *buf, size_t size) { // tally the status line of each response
+         if (size > 12 && memcmp(buf, "HTTP/1.1 ", 9) == 0) {
+            int status = atoi((const char *)buf + 9);
+            if (status == 429) ++flood_got[who].limited;
+            else if (status == 503) ++flood_got[who].busy;
+            else {
+               ++flood_got[who].answered;
+               if (millis() - asked_millis > flood_got[who].max_wait_msec)
+                  flood_got[who].max_wait_msec = millis() - asked_millis; }
+            asked_millis = millis(); }
+         return size; }
+      uint8_t connected(void) {
+         return open; }
+      int available(void) {
+         return open ? length - sent : 0; }
+      int read(void) {
+         return open && sent < length ? request[sent++ % request_length] : -1; }
+      int peek(void) {
+         return open && sent < length ? request[sent % request_length] : -1; }
+      void stop(void) {
+         open = false; }
+      IPAddress remoteIP(void) {
+         return addr; } };
+
+static flood_client_t flood_clients[FLOOD_SOCKETS]; // the browser's is the first
+static unsigned long flood_browser_millis, flood_scans;
+static bool flood_scanner_next;
+
+static WiFiClient *flood_available(void) { // a new connection from a made-up client, if one has a free socket
+   static const char keep_request[] = "GET / HTTP/1.1\r\nHost: 10.0.0.1\r\n\r\n";
+   static const char close_request[] = "GET / HTTP/1.1\r\nHost: 10.0.0.1\r\nConnection: close\r\n\r\n";
+   flood_client_t *pc = &flood_clients[0];
+   if (!pc->open && millis() - flood_browser_millis >= FLOOD_BROWSER_MSEC) {
+      flood_browser_millis = millis();
+      add_IP_address(IPAddress(10, 0, 0, 2))->gave_password = true; // (it did so earlier)
+      pc->start(0, FLOOD_BROWSER, IPAddress(10, 0, 0, 2), close_request, 1);
+      return pc; }
+   int ndx = 1;
+   while (ndx < FLOOD_SOCKETS && flood_clients[ndx].open) ++ndx;
+   if (ndx >= FLOOD_SOCKETS) return NULL;
+   pc = &flood_clients[ndx];
+   flood_scanner_next = !flood_scanner_next;
+   if (flood_scanner_next) {
+      pc->start(ndx, FLOOD_SCANNER, IPAddress(10, 1, (byte)(flood_scans >> 8), (byte)flood_scans), close_request, 1);
+      ++flood_scans; }
+   else pc->start(ndx, FLOOD_GREEDY, IPAddress(10, 0, 0, 66), keep_request, KEEPALIVE_REQUESTS);
+   return pc; }
+
+static void flood_close_all(void) { // close every connection, real or made-up
+   for (int ndx = 0; ndx < MAX_CONNECTIONS; ++ndx) {
+      if (connections[ndx].state != CONN_FREE) connections[ndx].pclient->stop();
+      connections[ndx].state = CONN_FREE;
+      connections[ndx].pclient = &connections[ndx].client; } }
+
+static void flood_check(bool ok, const char *problem, int *ppassed, int *pfailed) {
+   if (ok) ++*ppassed;
+   else {
+      Serial.print("  FAILED: "); Serial.println(problem);
+      ++*pfailed; } }
+
+static void flood_run(unsigned long secs, bool limited) {
+   for (int ndx = 0; ndx < FLOOD_SOCKETS; ++ndx) flood_clients[ndx].open = false;
+   memset(flood_got, 0, sizeof(flood_got));
+   flood_browser_millis = millis() - FLOOD_BROWSER_MSEC;
+   flood_scans = 0;
+   flood_scanner_next = false;
+   web_limits = limited;
+   flooding = true;
+   idle(); // (so the histogram starts from here)
+   memset(&idle_intervals, 0, sizeof(idle_intervals));
+   unsigned long start_millis = millis();
+   while (millis() - start_millis < secs * 1000) {
+      delay(FLOOD_TURN_MSEC); // (the control loop's own work)
+      idle(); }
+   flooding = false;
+   web_limits = true;
+   flood_close_all();
+   char string[MAXLINE];
+   sprintf(string, "  %s admission control:", limited ? "with" : "without");
+   Serial.println(string);
+   format_timing(string, "    time between calls to idle()", &idle_intervals);
+   Serial.println(string);
+   for (int who = 0; who < FLOOD_CLIENTS; ++who) {
+      sprintf(string, "    %-8s %6ld answered %6ld limited %6ld busy, longest wait %5lu msec", flood_client_names[who],
+              flood_got[who].answered, flood_got[who].limited, flood_got[who].busy, flood_got[who].max_wait_msec);
+      Serial.println(string); } }
+
+void web_flood(int secs) { // flood the server with requests and report what it did to the control loop
+   static struct client_t saved_clients[MAX_IP_ADDRESSES]; // (the visitors are put back afterwards)
+   static unsigned short saved_client_hash[IP_HASH_SIZE];
+   short saved_num_clients = num_clients, saved_newest = newest_client, saved_oldest = oldest_client;
+   struct rsp_stats_t saved_stats[RSP_NONE];
+   struct parse_stats_t saved_parse_stats = parse_stats;
+   struct timing_histogram_t saved_intervals = idle_intervals;
+   struct stall_t saved_stalls[NUM_STALLS];
+   unsigned long saved_num_stalls = num_stalls;
+   struct bucket_t saved_budget = web_budget;
+   long saved_limited = requests_limited, saved_over_budget = requests_over_budget;
+   long saved_processed = requests_processed, saved_accepted = connections_accepted, saved_refused = connections_refused;
+   long saved_reused = connections_reused, saved_reclaimed = connections_reclaimed;
+   int saved_max_busy = connections_max_busy;
+   Serial.print("web flood, compiled " __DATE__ " " __TIME__ ", ");
+   Serial.print(secs); Serial.print(" seconds each way, with idle() called every ");
+   Serial.print(FLOOD_TURN_MSEC); Serial.println(" msec");
+   unsigned long start_millis = millis();
+   while (web_status != WEB_AWAITING_CLIENT && millis() - start_millis < FLOOD_WAIT_SECS * 1000) {
+      delay(FLOOD_TURN_MSEC);
+      idle(); }
+   if (web_status != WEB_AWAITING_CLIENT) {
+      Serial.println("  the web server isn't running");
+      showing_screen = false;
+      return; }
+   for (int ndx = 0; ndx < MAX_IP_ADDRESSES; ++ndx) saved_clients[ndx] = clients[ndx];
+   memcpy(saved_client_hash, client_hash, sizeof(client_hash));
+   memcpy(saved_stats, rsp_stats, sizeof(rsp_stats));
+   memcpy(saved_stalls, stalls, sizeof(saved_stalls));
+   flood_close_all();
+   flood_run(secs, false);
+   unsigned long unlimited_wait_msec = flood_got[FLOOD_BROWSER].max_wait_msec;
+   flood_run(secs, true);
+   int passed = 0, failed = 0;
+   flood_check(idle_intervals.max_msec <= FLOOD_IDLE_MSEC, "the control loop waited too long", &passed, &failed);
+   flood_check(flood_got[FLOOD_BROWSER].answered > 0 && flood_got[FLOOD_BROWSER].limited == 0
+               && flood_got[FLOOD_BROWSER].busy == 0, "the browser was refused", &passed, &failed);
+   flood_check(flood_got[FLOOD_BROWSER].max_wait_msec <= unlimited_wait_msec + FLOOD_TURN_MSEC,
+               "the browser waited longer than without the limits", &passed, &failed);
+   flood_check(flood_got[FLOOD_SCANNER].limited > 0, "the scanner was never limited", &passed, &failed);
+   Serial.print("flood checks: "); Serial.print(passed); Serial.print(" passed, ");
+   Serial.print(failed); Serial.println(" failed");
+   for (int ndx = 0; ndx < MAX_IP_ADDRESSES; ++ndx) clients[ndx] = saved_clients[ndx];
+   memcpy(client_hash, saved_client_hash, sizeof(client_hash));
+   num_clients = saved_num_clients;
+   newest_client = saved_newest;
+   oldest_client = saved_oldest;
+   memcpy(rsp_stats, saved_stats, sizeof(rsp_stats));
+   parse_stats = saved_parse_stats;
+   idle_intervals = saved_intervals;
+   memcpy(stalls, saved_stalls, sizeof(saved_stalls));
+   num_stalls = saved_num_stalls;
+   web_budget = saved_budget;
+   requests_limited = saved_limited;
+   requests_over_budget = saved_over_budget;
+   requests_processed = saved_processed;
+   connections_accepted = saved_accepted;
+   connections_refused = saved_refused;
+   connections_reused = saved_reused;
+   connections_reclaimed = saved_reclaimed;
+   connections_max_busy = saved_max_busy;
+   showing_screen = false; }
+#endif
+
+static void respond(struct connection_t *pc, enum response_type_t response_type) {
+   // send a response, and keep the connection open for another request if we can
+   bool keep_alive = pc->request.keep_alive && ++pc->requests < KEEPALIVE_REQUESTS;
+   ++turn_responses;
+   pc->state = CONN_FREE;
+   if (generate_response(pc->pclient, response_type, keep_alive)) {
+      pc->state = CONN_IDLE;
+      pc->idle_millis = millis(); } }
+
+static void respond_to_request(struct connection_t *pc) { // we've read the request: respond to it
+   struct web_request_t *preq = &pc->request;
+   enum response_type_t response_type = RSP_UNKNOWN;
+   struct client_t *visitor = add_IP_address(pc->pclient->remoteIP());
    #if HTML_SHOW_RSP
-   Serial.println("closing client connection from generate_response()...");
+   Serial.print("---received request type "); Serial.print(preq->type);
+   Serial.print(" \""); Serial.print(request_type_names[preq->type]);
+   Serial.print(preq->rejected ? "\" (rejected)" : "\""); Serial.print(" at time ");
+   Serial.println(float(millis()) / 1000);
    showing_screen = false;
    #endif
-   while (pclient->connected() && pclient->available() > 0) pclient->read(); // make sure input is empty
-   delay(10);
-   if (pclient->connected()) pclient->stop(); // stop the TCP connection
-   //delete pclient;
-   web_status = WEB_AWAITING_CLIENT; }
 
-void process_client_request(WiFiClient *pclient) {
-   enum request_type_t request_type = REQ_UNKNOWN;
-   enum response_type_t response_type = RSP_UNKNOWN;
+   if (preq->type != REQ_FAVICON) {
+      ++visitor->count;  ++requests_processed; }
+   if (pc->requests > 0) ++connections_reused;
+
+   if (preq->rejected) { // don't bother responding to a broken or hostile client
+      pc->pclient->stop();
+      pc->state = CONN_FREE;
+      return; }
+
+   if (preq->type == REQ_EVENTS) { // keep the connection open, and send it changes
+      events_start(pc);
+      return; }
+
+   // done with HTTP request; figure out what kind of response to generate
+   if (preq->type == REQ_ROOT)  // normal request for the status page
+      response_type = RSP_STATUS;
+   else if ((preq->type == REQ_BUTTONIMAGE || preq->type == REQ_FAVICON) && preq->have_image) {
+      not_modified_etag = image_etag(preq->type == REQ_BUTTONIMAGE);
+      response_type = RSP_NOTMODIFIED; }
+   else if (preq->type == REQ_BUTTONIMAGE)
+      response_type = RSP_BUTTONIMAGE;
+   else if (preq->type == REQ_LOG || preq->type == REQ_LOGJSON || preq->type == REQ_LOGCSV || preq->type == REQ_LOGBIN) {
+      log_since = preq->log_since;
+      log_limit = preq->log_limit;
+      response_type = preq->type == REQ_LOG ? RSP_LOG : preq->type == REQ_LOGJSON ? RSP_LOGJSON
+                      : preq->type == REQ_LOGCSV ? RSP_LOGCSV : RSP_LOGBIN; }
+   else if (preq->type == REQ_VISITORS)
+      response_type = RSP_VISITORS;
+   else if (preq->type == REQ_FAVICON)
+      response_type = RSP_FAVICON;
+   else if (preq->type == REQ_STATS)
+      response_type = RSP_STATS;
+   else if (preq->type == REQ_PROFILE)
+      response_type = RSP_PROFILE;
+   else if (preq->type == REQ_TRACE)
+      response_type = RSP_TRACE;
+   else if (preq->type == REQ_JSON)
+      response_type = RSP_JSON;
+   else if (preq->type == REQ_METRICS)
+      response_type = RSP_METRICS;
+   else if (preq->type == REQ_CONFIG || preq->type == REQ_CONFIGJSON) {
+      config_msg = NULL;
+      response_type = preq->type == REQ_CONFIG ? RSP_CONFIG : RSP_CONFIGJSON; }
+   else if (preq->type == REQ_SETCONFIG || preq->type == REQ_PUTCONFIG) {
+      config_change(preq, visitor);
+      response_type = preq->type == REQ_SETCONFIG ? RSP_CONFIG : RSP_CONFIGJSON; }
+
+   else if (preq->type == REQ_PUSHBUTTON) {
+      if (preq->button >= 0) {
+         if (visitor->gave_password) { // already provided the password
+            queue_button_push(preq->button); // push the button
+            pc->delayed_millis = millis(); // but delay the response until it's acted on
+            pc->state = CONN_DELAYED;
+            return; }
+         else response_type = RSP_ASKPASS; } } // need to ask for password first
+
+   else if (preq->type == REQ_SETPASS) {
+      if (preq->password_ok) {
+         visitor->gave_password = true;
+         response_type = RSP_STATUS; } //  could also have saved pushbutton and act on it here
+      else if (preq->got_body) response_type = RSP_ASKPASS; }
+
+   respond(pc, response_type); }
+
+static WiFiClient *server_available(byte *status) { // a new client, or one with more to read, if any
+   static WiFiClient newclient;
+   #if SIMULATE
+   if (flooding) return flood_available();
+   #endif
+   newclient = server.available(status);
+   return newclient ? &newclient : NULL; }
+
+static void accept_client(void) { // take a new client into a free slot, if there is one
+   byte status;
+   WiFiClient *pnewclient = server_available(&status);
+   if (!pnewclient) return;
+   struct connection_t *pc = NULL;
+   int busy = 1;
+   for (int ndx = 0; ndx < MAX_CONNECTIONS; ++ndx) {
+      if (connections[ndx].state == CONN_FREE) {
+         if (!pc) pc = &connections[ndx]; }
+      else if (*connections[ndx].pclient == *pnewclient) return; // one we already have, with more to read
+      else ++busy; }
+   #if DEBUG
+   print_client_info("got client", pnewclient, status);
+   #endif
+   if (!pc) // they're all busy, so we'd close the connection that has been idle longest, if any
+      for (int ndx = 0; ndx < MAX_CONNECTIONS; ++ndx)
+         if (connections[ndx].state == CONN_IDLE
+               && (!pc || millis() - connections[ndx].idle_millis > millis() - pc->idle_millis))
+            pc = &connections[ndx];
+   if (!pc) { // or tell it to try again soon
+      ++connections_refused;
+      client_refuse(pnewclient, "503 Service Unavailable");
+      return; }
+   if (!admit_request(add_IP_address(pnewclient->remoteIP()))) { // too many requests: say so before reading any of it
+      client_refuse(pnewclient, "429 Too Many Requests");
+      return; }
+   if (pc->state == CONN_IDLE) { // close the idle connection whose slot it gets
+      ++connections_reclaimed;
+      --busy;
+      pc->pclient->stop(); }
+   ++connections_accepted;
+   set_activity(ACT_WEB_REQUEST);
    #if HTML_SHOW_REQ
    Serial.print("\nnew request from ");
-   Serial.print(pclient->remoteIP());
+   Serial.print(pnewclient->remoteIP());
    Serial.print(": ");
-   Serial.print(pclient->remotePort());
+   Serial.print(pnewclient->remotePort());
+   Serial.print(" in slot ");
+   Serial.print(pc - connections);
    Serial.print(" at time ");
    Serial.println((float)millis() / 1000);
    showing_screen = false;
    #endif
-   current_client = add_IP_address(pclient);
-
-   while (get_request_line(pclient, linebuf)) {
-      if (HTML_SHOW_REQ) {
-         // Serial.print() ignores embedded \r\n character sequences!
-         Serial.print("  "); Serial.println(linebuf); }
-      char *ptr = linebuf;
-      if (scan_key(&ptr, "GET")) {
-         if (scan_key(&ptr, "/ ")) request_type = REQ_ROOT;
-         else if (scan_key(&ptr, "/VISITORS ")) request_type = REQ_VISITORS;
-         else if (scan_key(&ptr, "/LOG ")) request_type = REQ_LOG;
-         else if (scan_key(&ptr, "/FAVICON.ICO ")) request_type = REQ_FAVICON;
-         else if (scan_key(&ptr, "/BUTTONIMAGE.JPG ")) request_type = REQ_BUTTONIMAGE; }
-      else if (scan_key(&ptr, "POST")) {
-         if (scan_key(&ptr, "/PUSHBUTTON.HTML")) request_type = REQ_PUSHBUTTON;
-         else if (scan_key(&ptr, "/SETPASS.HTML")) request_type = REQ_SETPASS; }    }
-   #if HTML_SHOW_RSP
-   Serial.print("---received request type "); Serial.print(request_type);
-   Serial.print(" \""); Serial.print(request_type_names[request_type]);
-   Serial.print("\" at time "); Serial.println(float(millis()) / 1000);
-   showing_screen = false;
+   pc->client = *pnewclient;
+   pc->pclient = &pc->client;
+   #if SIMULATE
+   if (flooding) pc->pclient = pnewclient; // (a made-up client, which a copy would lose)
    #endif
+   pc->state = CONN_READING;
+   pc->requests = 0;
+   request_start(&pc->request);
+   if (busy > connections_max_busy) connections_max_busy = busy; }
 
-   if (request_type != REQ_FAVICON) {
-      ++current_client->count;  ++requests_processed; }
+static bool serve_connections(void) { // give each slot a turn; return true if any has a request underway
+   static int first_slot = 0; // where to start, so the slots take turns making the responses
+   bool underway = false;
+   turn_responses = 0;
+   for (int count = 0; count < MAX_CONNECTIONS; ++count) {
+      int ndx = (first_slot + count) % MAX_CONNECTIONS;
+      struct connection_t *pc = &connections[ndx];
+      bool may_respond = !web_limits || turn_responses < RESPONSES_PER_TURN; // (or else wait for the next call)
+      web_status = WEB_PROCESSING_REQUEST;
+      switch (pc->state) {
+         case CONN_READING:
+            if (may_respond && request_read(pc->pclient, &pc->request)) {
+               respond_to_request(pc);
+               first_slot = (ndx + 1) % MAX_CONNECTIONS; }
+            break;
+         case CONN_DELAYED:
+            if (may_respond && millis() - pc->delayed_millis > DELAYED_RSP_MSEC) {
+               if (DEBUG) {
+                  Serial.println("generating delayed response from button push");
+                  showing_screen = false; }
+               respond(pc, RSP_STATUS);
+               first_slot = (ndx + 1) % MAX_CONNECTIONS; }
+            break;
+         case CONN_EVENTS:
+            events_update(pc);
+            break;
+         case CONN_IDLE: // waiting for another request on a connection we kept open
+            if (pc->pclient->available() > 0) {
+               if (admit_request(add_IP_address(pc->pclient->remoteIP()))) {
+                  pc->state = CONN_READING;
+                  request_start(&pc->request); }
+               else { // too many requests: say so before reading any of it
+                  client_refuse(pc->pclient, "429 Too Many Requests");
+                  pc->state = CONN_FREE; } }
+            else if (!pc->pclient->connected() || millis() - pc->idle_millis > KEEPALIVE_MSEC) {
+               pc->pclient->stop();
+               pc->state = CONN_FREE; }
+            break;
+         case CONN_FREE:
+            break; }
+      web_status = WEB_AWAITING_CLIENT;
+      if (pc->state == CONN_READING || pc->state == CONN_DELAYED) underway = true; }
+   return underway; }
 
-   // done with HTTP request header; figure out what kind of response to generate
-   if (request_type == REQ_ROOT)  // normal request for the status page
-      response_type = RSP_STATUS;
-   else if (request_type == REQ_BUTTONIMAGE)
-      response_type = RSP_BUTTONIMAGE;
-   else if (request_type == REQ_LOG)
-      response_type = RSP_LOG;
-   else if (request_type == REQ_VISITORS)
-      response_type = RSP_VISITORS;
-   else if (request_type == REQ_FAVICON)
-      response_type = RSP_FAVICON;
+#if SIMULATE
+// The regression tests make requests from a made-up client at 10.0.0.9, which sends one request
+// and keeps the start of the response. They go through the same parser and responder as the
+// WiFi module's clients do, but not the admission control. The tests also check the visitor
+// table directly: every entry must be found from its hash slot, and be on the list by recent
+// visit once. See the "web", "webhas", "visit", and "visitor" commands in gensimulate.cpp.
+#define WEB_TEST_BYTES 8192 // how much of a response we keep
+
+class web_test_client_t : public WiFiClient {
+   public:
+      const char *data;         // the request
+      unsigned long length, sent;
+      bool open;                // (until we're done with it)
+      char response[WEB_TEST_BYTES + 1];
+      unsigned long response_length;
+      size_t write(const uint8_t *buf, size_t size) {
+         size_t room = WEB_TEST_BYTES - response_length;
+         if (size < room) room = size;
+         memcpy(response + response_length, buf, room);
+         response_length += room;
+         return size; }
+      uint8_t connected(void) {
+         return open; }
+      int available(void) {
+         return length - sent; }
+      int read(void) {
+         return sent < length ? (byte)data[sent++] : -1; }
+      void stop(void) {
+         open = false; }
+      IPAddress remoteIP(void) {
+         return IPAddress(10, 0, 0, 9); } };
+
+static web_test_client_t web_test_client;
+static struct connection_t web_test_connection;
+static char web_test_etag[12] = "", web_test_next[12] = ""; // from earlier responses, for $etag and $next
+
+static void web_test_expand(char *dst, const char *src, int size) { // copy, replacing $etag and $next
+   while (*src && size > 12) {
+      const char *value = strncmp(src, "$etag", 5) == 0 ? web_test_etag : strncmp(src, "$next", 5) == 0 ? web_test_next : NULL;
+      if (value) {
+         int length = sprintf(dst, "%s", value);
+         dst += length; size -= length;
+         src += 5; }
+      else {
+         *dst++ = *src++;
+         --size; } }
+   *dst = 0; }
 
-   else if (request_type == REQ_PUSHBUTTON) {
-      if (pclient->available() > 2) { // else what???
-         while (get_request_line(pclient, linebuf)) {
-            //Serial.print("post body line for pushbutton:"); Serial.println(linebuf); //TEMP
-            char *ptr = linebuf; int button;
-            if (scan_key(&ptr, "BUTTON=") && scan_int(&ptr, &button, 0, NUM_BUTTONS - 1)) {
-               if (current_client->gave_password) { // already provided the password
-                  queue_button_push(button); // push the button
-                  response_type = RSP_NONE; // but delay response until acted on
-               }
-               else response_type = RSP_ASKPASS; // need to ask for password first
-            } } } }
-
-   else if (request_type == REQ_SETPASS) {
-      while (get_request_line(pclient, linebuf)) {
-         //Serial.print("post body line for password:"); Serial.println(linebuf); //TEMP
-         char *ptr = linebuf;
-         if (scan_key(&ptr, "PWD=") && check_password(ptr)) {
-            current_client->gave_password = true;
-            response_type = RSP_STATUS; } //  could also have saved pushbutton and act on it here
-         else response_type = RSP_ASKPASS; } }
-
-   if (response_type != RSP_NONE) generate_response(pclient, response_type); }
+static void web_test_remember(const char *name, char *value, int size) { // keep a value from the response, if it's there
+   const char *ptr = strstr(web_test_client.response, name);
+   int length = 0;
+   if (!ptr) return;
+   ptr += strlen(name);
+   while (ptr[length] && ptr[length] != '\r' && ptr[length] != ',' && length < size - 1) ++length;
+   memcpy(value, ptr, length);
+   value[length] = 0; }
+
+int web_test_request(const char *request) {
+   // Make a request like "PUT /config.json | <header> | <header> || <body>", and return the
+   // response's status, or 0 if there wasn't one. $etag is the ETag of the last response that
+   // had one, and $next is the "next" entry number of the last /log.json response.
+   static char text[MAXLINE], data[MAXLINE + 100];
+   if (rsp_counting) return 0; // (a real response is underway, and we'd share its buffer)
+   web_test_expand(text, request, sizeof(text));
+   char *body = strstr(text, " || ");
+   if (body) {
+      *body = 0;
+      body += 4; }
+   char *header = strstr(text, " | ");
+   if (header) {
+      *header = 0;
+      header += 3; }
+   int length = sprintf(data, "%s HTTP/1.1\r\nHost: 10.0.0.1\r\nConnection: close\r\n", text);
+   while (header) {
+      char *next = strstr(header, " | ");
+      if (next) {
+         *next = 0;
+         next += 3; }
+      length += snprintf(data + length, sizeof(data) - length, "%s\r\n", header);
+      header = next; }
+   if (body) snprintf(data + length, sizeof(data) - length, "Content-Length: %d\r\n\r\n%s", (int)strlen(body), body);
+   else snprintf(data + length, sizeof(data) - length, "\r\n");
+   web_test_client.data = data;
+   web_test_client.length = strlen(data);
+   web_test_client.sent = web_test_client.response_length = 0;
+   web_test_client.open = true;
+   struct connection_t *pc = &web_test_connection;
+   pc->pclient = &web_test_client;
+   pc->state = CONN_READING;
+   pc->requests = 0;
+   read_request(&web_test_client, &pc->request);
+   respond_to_request(pc);
+   web_test_client.response[web_test_client.response_length] = 0;
+   web_test_remember("\r\nETag: ", web_test_etag, sizeof(web_test_etag));
+   web_test_remember("\"next\":", web_test_next, sizeof(web_test_next));
+   return strncmp(web_test_client.response, "HTTP/1.1 ", 9) == 0 ? atoi(web_test_client.response + 9) : 0; }
+
+bool web_test_response_has(const char *text) { // is this in what we kept of the last response?
+   return strstr(web_test_client.response, text) != NULL; }
+
+static bool web_test_visitors_ok(void) { // is the visitor table consistent?
+   int hashed = 0, listed = 0;
+   for (unsigned slot = 0; slot < IP_HASH_SIZE; ++slot)
+      if (client_hash[slot] != 0) {
+         unsigned found;
+         ++hashed;
+         if (ip_find(clients[client_hash[slot] - 1].ip_address, &found) != client_hash[slot] - 1 || found != slot)
+            return false; } // (a gap in its probe sequence, or it's in the table twice)
+   for (int ndx = newest_client; ndx >= 0 && listed <= num_clients; ndx = clients[ndx].older) ++listed;
+   return hashed == num_clients && listed == num_clients; }
+
+bool web_test_visit(IPAddress addr, int count) {
+   // record a visit from each of count addresses starting with this one, and check the visitor
+   // table after each; return false if it went wrong
+   uint32_t val = ((uint32_t)addr[0] << 24) | ((uint32_t)addr[1] << 16) | ((uint32_t)addr[2] << 8) | addr[3];
+   for (; count > 0; --count, ++val) {
+      ++add_IP_address(IPAddress((byte)(val >> 24), (byte)(val >> 16), (byte)(val >> 8), (byte)val))->count;
+      if (!web_test_visitors_ok()) return false; }
+   return true; }
+
+long web_test_visitor(IPAddress addr) { // how many requests this visitor made, or -1 if it's not in the table
+   unsigned slot;
+   int ndx = ip_find(addr, &slot);
+   return ndx >= 0 ? clients[ndx].count : -1; }
+#endif
 
 #ifdef IFTTT_EVENT
 void ifttt_send_trigger(WiFiClient *pclient) {
@@ -502,9 +2514,11 @@ void ifttt_send_trigger(WiFiClient *pclient) {
       showing_screen = false; }
    pclient->stop();
    if (IFTTT_LOG) log_eventf(EV_IFTTT_SENDING, "\"%s\"", ifttt_data);
+   set_activity(ACT_IFTTT_SEND);
    ++ifttt_sends;
    if (pclient->connect(ifttt_server, 80)) { // send the trigger
       sprintf(json_string, "{\"value1\" : \"%s\"}", ifttt_data);
+      client_buffer_start();
       client_printf(pclient, "POST %s HTTP/1.1\r\n", ifttt_path);
       client_printf(pclient, "Host: %s\r\n", ifttt_server);
       client_printf(pclient, "Content-Length: %d\r\n", strlen(json_string));
@@ -512,6 +2526,7 @@ void ifttt_send_trigger(WiFiClient *pclient) {
       client_printf(pclient, "Connection: close\r\n");
       client_printf(pclient, "\r\n");
       client_printf(pclient, "%s\r\n", json_string);
+      client_flush(pclient);
       while (pclient->connected()) {  // read the server's entire response
          while (pclient->available()) {
             char c = pclient->read();
@@ -547,7 +2562,10 @@ void process_web(void) {
       // because the house's WiFi access points and network routers will be down.
       // It just slows things down because some of the WiFiNINA calls are blocking.
       // Also, the IFTTT trigger message will fail, and we don't currently do retries for that.
+      PROFILE_ZONE(PZ_PROCESS_WEB);
       processing_web = true;
+      stack_web_depth = stack_depth();
+      stack_note(SP_PROCESS_WEB, stack_web_depth);
       switch (web_status) {
 
          case WEB_NOT_CONNECTED:
@@ -570,6 +2588,7 @@ void process_web(void) {
                SEROUT("begin");
                digitalWrite(WIFI_LED, WIFI_LED_ON); // turn LED on to show the attempt
                // This can block for as long as 50 seconds! So our watchdog timeout must be longer.
+               set_activity(ACT_WIFI_BEGIN);
                int connectstatus = WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
                SEROUT("began");
                if (DEBUG) {
@@ -633,34 +2652,34 @@ void process_web(void) {
                   showing_screen = false; }
                if (WIFI_LOG) log_event(EV_WIFI_RESET);
                wifi_reset();
+               for (int ndx = 0; ndx < MAX_CONNECTIONS; ++ndx)
+                  connections[ndx].state = CONN_FREE; // (their sockets are gone)
                connect_attempts = 0;
                next_connect_time = now() + CONNECT_DELAY_SECS; // when to try next
                web_status = WEB_NOT_CONNECTED; }
             else {
-               if (check_for_client("got client")) {
-                  //https://arduino.stackexchange.com/questions/31256/multiple-client-server-over-wifi/31263
-                  web_status = WEB_PROCESSING_REQUEST;
-                  process_client_request(&client); }
-               #ifdef IFTTT_EVENT
-               else if (ifttt_do_trigger  // we're idle so could process an outgoing trigger
-                        && millis() - ifttt_trytime_millis >= IFTTT_DELAY_SECS * 1000) { // if it's time
-                  ifttt_send_trigger(&client); } // make an attempt
-               #endif
-            }
+               accept_client();
+               if (!serve_connections()) { // nobody has a request underway
+                  #ifdef IFTTT_EVENT
+                  if (ifttt_do_trigger  // we're idle so could process an outgoing trigger
+                        && millis() - ifttt_trytime_millis >= IFTTT_DELAY_SECS * 1000) // if it's time
+                     ifttt_send_trigger(&client); // make an attempt
+                  #endif
+               } }
             break;
 
-         case WEB_PROCESSING_REQUEST:
-            assert(delayed_response, "not delayed rsp?");
-            if (millis() > delayed_sendtime) {
-               delayed_response = false;
-               if (DEBUG) {
-                  Serial.println("generating delayed response from button push");
-                  showing_screen = false; }
-               generate_response(&client, RSP_STATUS); } } }
+         case WEB_PROCESSING_REQUEST: // (only while serve_connections() is running)
+            break; } }
    SEROUT(".");
    processing_web = false;
+   stack_web_depth = 0;
    return; }
 #else
+const char *web_status_names[] = {"no WiFi" };
+
+byte web_state(void) {
+   return 0; }
+
 void process_web(void) {
    return; }
 #endif //WIFI
@@ -0,0 +1,177 @@
+// file: Arduino.h
+/* ----------------------------------------------------------------------------------------
+   The parts of the Teensy 3.5 Arduino core that the controller uses, for the Linux host
+   build. The serial port is stdin and stdout, the pins and hardware registers are just
+   memory, and the clocks are the real ones. See host.cpp.
+   ----------------------------------------------------------------------------------------*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define DEC 10
+#define HEX 16
+
+#define F_CPU 120000000   // what the Teensy 3.5 runs at, for the PROFILE cycle counts
+#define E2END 0xFFF       // the last byte of its 4K of EEPROM
+
+#define A0 14             // the analog pins
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+
+#define B00000 0          // the binary constants we use for the LCD's custom characters
+#define B00100 4
+#define B01110 14
+#define B10101 21
+
+#define min(a, b) ({ __typeof__(a) _a = (a); __typeof__(b) _b = (b); _a < _b ? _a : _b; })
+#define max(a, b) ({ __typeof__(a) _a = (a); __typeof__(b) _b = (b); _a > _b ? _a : _b; })
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long msec);
+void delayMicroseconds(unsigned usec);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+uint8_t digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogReference(uint8_t type);
+static inline void noInterrupts(void) { }
+static inline void interrupts(void) { }
+
+// the watchdog registers, which never reset us; its timer counts the 1 KHz LPO clock
+extern volatile uint16_t WDOG_UNLOCK, WDOG_TOVALH, WDOG_TOVALL, WDOG_WINH, WDOG_WINL,
+       WDOG_PRESC, WDOG_STCTRLH, WDOG_RSTCNT, WDOG_REFRESH;
+uint16_t host_lpo_millis(void);
+#define WDOG_TMROUTL host_lpo_millis()
+#define WDOG_STCTRLH_WAITEN 0x0080
+#define WDOG_STCTRLH_STOPEN 0x0040
+#define WDOG_STCTRLH_DBGEN 0x0020
+#define WDOG_STCTRLH_ALLOWUPDATE 0x0010
+#define WDOG_STCTRLH_WDOGEN 0x0001
+
+extern volatile uint32_t host_rfsys_reg0; // the system register file word that survives a reset
+#define RFSYS_REG0 host_rfsys_reg0
+
+// the cycle counter for PROFILE, which counts F_CPU cycles of real time
+extern volatile uint32_t ARM_DEMCR, ARM_DWT_CTRL;
+uint32_t host_cycles(void);
+#define ARM_DWT_CYCCNT host_cycles()
+#define ARM_DEMCR_TRCENA (1 << 24)
+#define ARM_DWT_CTRL_CYCCNTENA 1
+
+class Print;
+
+class Printable {
+   public:
+      virtual size_t printTo(Print &p) const = 0; };
+
+class Print {
+   public:
+      virtual size_t write(uint8_t b) = 0;
+      virtual size_t write(const uint8_t *buf, size_t size) {
+         size_t count = 0;
+         while (size--) count += write(*buf++);
+         return count; }
+      size_t write(const char *str) {
+         return write((const uint8_t *)str, strlen(str)); }
+      size_t write(const char *buf, size_t size) {
+         return write((const uint8_t *)buf, size); }
+      virtual void flush(void) { }
+      size_t print(const char *str) {
+         return write(str); }
+      size_t print(char c) {
+         return write((uint8_t)c); }
+      size_t print(int val, int base = DEC) {
+         return print((long)val, base); }
+      size_t print(unsigned val, int base = DEC) {
+         return print((unsigned long)val, base); }
+      size_t print(long val, int base = DEC) {
+         return base == DEC ? printf("%ld", val) : print((unsigned long)val, base); }
+      size_t print(unsigned long val, int base = DEC) {
+         return printf(base == HEX ? "%lX" : "%lu", val); }
+      size_t print(double val, int digits = 2) {
+         return printf("%.*f", digits, val); }
+      size_t print(const Printable &obj) {
+         return obj.printTo(*this); }
+      size_t println(void) {
+         return write("\r\n"); }
+      template <typename T> size_t println(T val) {
+         size_t count = print(val);
+         return count + println(); }
+      template <typename T> size_t println(T val, int format) {
+         size_t count = print(val, format);
+         return count + println(); }
+      size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3))); };
+
+class Stream : public Print {
+   public:
+      virtual int available(void) = 0;
+      virtual int read(void) = 0;
+      virtual int peek(void) = 0; };
+
+class usb_serial_class : public Stream { // stdin and stdout
+   public:
+      void begin(long baud) { }
+      operator bool() {
+         return true; }
+      int available(void);
+      int read(void);
+      int peek(void);
+      size_t write(uint8_t b);
+      size_t write(const uint8_t *buf, size_t size);
+      void flush(void);
+      using Print::write; };
+extern usb_serial_class Serial;
+
+class HardwareSerial : public Stream { // a port with nothing attached
+   public:
+      void begin(long baud) { }
+      void setTX(uint8_t pin) { }
+      int available(void) {
+         return 0; }
+      int read(void) {
+         return -1; }
+      int peek(void) {
+         return -1; }
+      size_t write(uint8_t b) {
+         return 1; }
+      using Print::write; };
+extern HardwareSerial Serial1, Serial2, Serial3, Serial4, Serial5, Serial6;
+
+class IPAddress : public Printable {
+   public:
+      IPAddress(void) {
+         memset(bytes, 0, sizeof(bytes)); }
+      IPAddress(uint8_t b0, uint8_t b1, uint8_t b2, uint8_t b3) {
+         bytes[0] = b0; bytes[1] = b1; bytes[2] = b2; bytes[3] = b3; }
+      IPAddress(uint32_t address) { // in network order, as it is in memory
+         memcpy(bytes, &address, sizeof(bytes)); }
+      operator uint32_t() const {
+         uint32_t address;
+         memcpy(&address, bytes, sizeof(address));
+         return address; }
+      bool operator==(const IPAddress &other) const {
+         return memcmp(bytes, other.bytes, sizeof(bytes)) == 0; }
+      uint8_t operator[](int index) const {
+         return bytes[index]; }
+      uint8_t &operator[](int index) {
+         return bytes[index]; }
+      size_t printTo(Print &p) const {
+         return p.printf("%d.%d.%d.%d", bytes[0], bytes[1], bytes[2], bytes[3]); }
+   private:
+      uint8_t bytes[4]; };
@@ -0,0 +1,14 @@
+// file: EEPROM.h
+/* ----------------------------------------------------------------------------------------
+   The Teensy EEPROM, for the Linux host build. It is kept in a file, which is changed as
+   each byte is written, so it survives a restart the way the real one does. See host.cpp.
+   ----------------------------------------------------------------------------------------*/
+#pragma once
+
+class EEPROMClass {
+   public:
+      uint8_t read(int addr);
+      void write(int addr, uint8_t val);
+      void update(int addr, uint8_t val) {
+         if (read(addr) != val) write(addr, val); } };
+extern EEPROMClass EEPROM;
@@ -0,0 +1,18 @@
+// file: LiquidCrystal.h
+// The LCD display, for the Linux host build, which has none. What the controller shows on it
+// is also on its web status page. See host.cpp.
+#pragma once
+
+class LiquidCrystal : public Print {
+   public:
+      LiquidCrystal(uint8_t rs, uint8_t enable, uint8_t d0, uint8_t d1, uint8_t d2, uint8_t d3) { }
+      void begin(uint8_t cols, uint8_t rows) { }
+      void clear(void) { }
+      void setCursor(uint8_t col, uint8_t row) { }
+      void createChar(uint8_t location, uint8_t charmap[]) { }
+      void noCursor(void) { }
+      void blink(void) { }
+      void noBlink(void) { }
+      size_t write(uint8_t b) {
+         return 1; }
+      using Print::write; };
@@ -0,0 +1,6 @@
+// file: SPI.h
+// The SPI port the WiFi module is on, which the Linux host build doesn't need. See host.cpp.
+#pragma once
+
+class SPIClass { };
+extern SPIClass SPI;
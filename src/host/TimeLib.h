@@ -0,0 +1,26 @@
+// file: TimeLib.h
+/* ----------------------------------------------------------------------------------------
+   The parts of the Time library and the Teensy realtime clock that the controller uses,
+   for the Linux host build. The realtime clock keeps local time, as the controller's
+   does, and starts out as the host's. See host.cpp.
+   ----------------------------------------------------------------------------------------*/
+#pragma once
+#include <time.h>
+
+typedef struct { // the parts of a time, with Year counted from 1970
+   uint8_t Second, Minute, Hour, Wday, Day, Month, Year; }
+TimeElements, tmElements_t;
+
+typedef time_t (*getExternalTime)(void);
+
+time_t now(void);
+void setTime(time_t t);
+time_t makeTime(const TimeElements &tm);
+void breakTime(time_t time, TimeElements &tm);
+void setSyncProvider(getExternalTime getTimeFunction);
+
+class teensy3_clock_class {
+   public:
+      unsigned long get(void);
+      void set(unsigned long t); };
+extern teensy3_clock_class Teensy3Clock;
@@ -0,0 +1,85 @@
+// file: WiFiNINA.h
+/* ----------------------------------------------------------------------------------------
+   The parts of the WiFiNINA library that the controller uses, for the Linux host build.
+   The "module" is the host's TCP/IP stack: the network is always there, the server listens
+   on all of the host's addresses, and the clients are sockets. As with the real module, a
+   WiFiClient is just the number of one of a few sockets, so it can be copied and compared.
+   See host.cpp.
+   ----------------------------------------------------------------------------------------*/
+#pragma once
+#include <SPI.h>
+
+#define WL_NO_SHIELD 255   // WiFi.status() values
+#define WL_IDLE_STATUS 0
+#define WL_NO_SSID_AVAIL 1
+#define WL_SCAN_COMPLETED 2
+#define WL_CONNECTED 3
+#define WL_CONNECT_FAILED 4
+#define WL_CONNECTION_LOST 5
+#define WL_DISCONNECTED 6
+
+#define CLOSED 0           // WiFiClient.status() values
+#define ESTABLISHED 4
+
+#define MAX_SOCK_NUM 10    // sockets the module has, for servers and clients
+#define NO_SOCKET_AVAIL 255
+
+class Client : public Stream {
+   public:
+      virtual int connect(const char *host, uint16_t port) = 0;
+      virtual size_t write(uint8_t b) = 0;
+      virtual size_t write(const uint8_t *buf, size_t size) = 0;
+      virtual int available(void) = 0;
+      virtual int read(void) = 0;
+      virtual int peek(void) = 0;
+      virtual void stop(void) = 0;
+      virtual uint8_t connected(void) = 0;
+      virtual operator bool() = 0;
+      using Print::write; };
+
+class WiFiClient : public Client {
+   public:
+      WiFiClient(void) : _sock(NO_SOCKET_AVAIL) { }
+      WiFiClient(uint8_t sock) : _sock(sock) { }
+      uint8_t status(void);
+      virtual int connect(const char *host, uint16_t port);
+      virtual size_t write(uint8_t b);
+      virtual size_t write(const uint8_t *buf, size_t size);
+      virtual int available(void);
+      virtual int read(void);
+      virtual int peek(void);
+      virtual void stop(void);
+      virtual uint8_t connected(void);
+      virtual operator bool() {
+         return _sock != NO_SOCKET_AVAIL; }
+      virtual bool operator==(const WiFiClient &other) const {
+         return _sock == other._sock; }
+      virtual IPAddress remoteIP(void);
+      virtual uint16_t remotePort(void);
+      using Print::write;
+   private:
+      uint8_t _sock; // which of the module's sockets
+      friend class WiFiServer; };
+
+class WiFiServer {
+   public:
+      WiFiServer(uint16_t port) : _port(port) { }
+      void begin(void);
+      WiFiClient available(uint8_t *status = NULL); // a new client, or one with something to read
+   private:
+      uint16_t _port; };
+
+class WiFiClass {
+   public:
+      void setPins(int8_t cs, int8_t ready, int8_t reset, int8_t gpio0, SPIClass *spi) { }
+      void config(IPAddress local_ip, IPAddress dns_server, IPAddress gateway, IPAddress subnet) { }
+      int begin(const char *ssid, const char *passphrase);
+      uint8_t status(void);
+      const char *firmwareVersion(void) {
+         return "host"; }
+      uint8_t *macAddress(uint8_t *mac);
+      const char *SSID(void);
+      IPAddress localIP(void);
+      long RSSI(void) { // (int32_t on the Teensy, which is a long)
+         return -40; } };
+extern WiFiClass WiFi;
@@ -0,0 +1,470 @@
+// file: host.cpp
+/* ----------------------------------------------------------------------------------------
+   The Linux host build of the controller
+
+   This runs the controller's code on a Linux computer, with the generator and transfer
+   switch simulated (see gensimulate.cpp), so that the control logic, the regression tests,
+   the web server, and the benchmarks can be run and debugged without a Teensy. The code is
+   the same; only the Teensy core and the libraries are replaced, by the headers here:
+     Arduino.h        the serial port is stdin and stdout, and the pins and registers are memory
+     EEPROM.h         the EEPROM is a file, written as each byte changes
+     TimeLib.h        the realtime clock keeps local time, and starts out as the host's
+     WiFiNINA.h       the WiFi module is the host's TCP/IP stack
+     LiquidCrystal.h  there is no display, but what it shows is on the web status page
+     SPI.h            (nothing)
+
+   usage: controller [-e eeprom_file] [-p port]
+     -e  the file for the EEPROM, which is created blank if it doesn't exist; default eeprom.bin
+     -p  the web server's port, instead of WIFI_PORT
+
+   Type the simulator's commands, or pipe them in. When the input ends we exit as soon as
+   the simulator has nothing more to do, so for example
+      echo test | ./controller -e /tmp/test.bin
+   runs the regression tests. "make test" does that with a new EEPROM file.
+
+   The web server answers once the simulated utility power has been on for a couple of
+   minutes, as on the controller (see POWER_ON_WEB_DELAY_SECS). The pauses at startup
+   for reading the display don't wait, since there is no display.
+
+   The controller's code runs on a stack of its own, STACK_SIZE bytes from host_stack[],
+   which is what the stack painting in the main module measures. The end of that array is
+   _estack and its start is __brkval, which on the Teensy come from the linker script and
+   the heap. Times are the host's, so the
+   benchmarks are much faster than on the Teensy, but can be compared with each other.
+   The watchdog never resets us.
+
+   Build it with "make" in this directory. See the main module for other details.
+   ----------------------------------------------------------------------------------------
+   Copyright (c) 2019,2020 Len Shustek
+   The MIT License (MIT)
+   Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+   and associated documentation files (the "Software"), to deal in the Software without
+   restriction, including without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in all copies or
+   substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+   BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+   DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+   ------------------------------------------------------------------------------------------------*/
+
+#define SIMULATOR  // we are the real hardware routines, not the simulated ones
+#include "generator.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+#define STACK_SIZE (1024 * 1024)      // the controller's stack
+#define CONNECT_TIMEOUT_SECS 10       // how long an outgoing connection may take, like the module's
+
+void setup(void);
+void loop(void);
+
+//-------------------------------------------------------
+//    clocks, pins, and registers
+//-------------------------------------------------------
+
+static struct timespec host_start_time;
+
+static unsigned long long host_usecs(void) { // the real time since we started
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (ts.tv_sec - host_start_time.tv_sec) * 1000000ULL
+          + (ts.tv_nsec - host_start_time.tv_nsec) / 1000; }
+
+unsigned long millis(void) {
+   return host_usecs() / 1000; }
+
+unsigned long micros(void) {
+   return host_usecs(); }
+
+void delay(unsigned long msec) {
+   struct timespec ts = {(time_t)(msec / 1000), (long)(msec % 1000) * 1000000L };
+   while (nanosleep(&ts, &ts) < 0 && errno == EINTR) ; }
+
+void delayMicroseconds(unsigned usec) {
+   struct timespec ts = {(time_t)(usec / 1000000), (long)(usec % 1000000) * 1000L };
+   while (nanosleep(&ts, &ts) < 0 && errno == EINTR) ; }
+
+#define NUM_PINS 64
+static uint8_t host_pins[NUM_PINS]; // what each pin was set to, or is pulled up to
+
+void pinMode(uint8_t pin, uint8_t mode) {
+   if (pin < NUM_PINS && mode == INPUT_PULLUP) host_pins[pin] = HIGH; } // (so buttons aren't pushed)
+
+static void host_wifi_reset(void);
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+   if (pin < NUM_PINS) host_pins[pin] = val;
+   if (pin == WIFI_RST && val == 0) host_wifi_reset(); }
+
+uint8_t digitalRead(uint8_t pin) {
+   return pin < NUM_PINS ? host_pins[pin] : LOW; }
+
+int analogRead(uint8_t pin) {
+   return 0; }
+
+void analogReference(uint8_t type) { }
+
+volatile uint16_t WDOG_UNLOCK, WDOG_TOVALH, WDOG_TOVALL, WDOG_WINH, WDOG_WINL,
+         WDOG_PRESC, WDOG_STCTRLH, WDOG_RSTCNT, WDOG_REFRESH;
+volatile uint32_t host_rfsys_reg0;
+volatile uint32_t ARM_DEMCR, ARM_DWT_CTRL;
+
+uint16_t host_lpo_millis(void) {
+   return (uint16_t)millis(); }
+
+uint32_t host_cycles(void) {
+   return (uint32_t)(host_usecs() * (F_CPU / 1000000)); }
+
+char host_stack[STACK_SIZE] __attribute__((aligned(16))); // the controller's stack,
+char *__brkval = host_stack;                               //   its bottom,
+#define QUOTE(x) #x
+#define EXPAND_QUOTE(x) QUOTE(x)
+__asm__(".globl _estack\n.set _estack, host_stack + " EXPAND_QUOTE(STACK_SIZE)); // and its top
+
+//-------------------------------------------------------
+//    serial ports
+//-------------------------------------------------------
+
+usb_serial_class Serial;
+HardwareSerial Serial1, Serial2, Serial3, Serial4, Serial5, Serial6;
+
+static char serial_input[256];
+static int serial_input_length = 0, serial_input_next = 0;
+static bool serial_input_ended = false;
+
+static void serial_fill(void) { // get what has been typed, if we have used up what we had
+   if (serial_input_next < serial_input_length || serial_input_ended) return;
+   struct pollfd pfd = {STDIN_FILENO, POLLIN, 0 };
+   if (poll(&pfd, 1, 0) <= 0) return;
+   int length = read(STDIN_FILENO, serial_input, sizeof(serial_input));
+   if (length <= 0) {
+      if (length == 0 || errno != EINTR) serial_input_ended = true;
+      return; }
+   serial_input_length = length;
+   serial_input_next = 0; }
+
+int usb_serial_class::available(void) {
+   serial_fill();
+   return serial_input_length - serial_input_next; }
+
+int usb_serial_class::read(void) {
+   serial_fill();
+   return serial_input_next < serial_input_length ? (byte)serial_input[serial_input_next++] : -1; }
+
+int usb_serial_class::peek(void) {
+   serial_fill();
+   return serial_input_next < serial_input_length ? (byte)serial_input[serial_input_next] : -1; }
+
+size_t usb_serial_class::write(uint8_t b) {
+   if (b != '\r') putchar(b); // (the line ends are "\r\n")
+   return 1; }
+
+size_t usb_serial_class::write(const uint8_t *buf, size_t size) {
+   for (size_t ndx = 0; ndx < size; ++ndx) write(buf[ndx]);
+   return size; }
+
+void usb_serial_class::flush(void) {
+   fflush(stdout); }
+
+size_t Print::printf(const char *format, ...) {
+   char buf[256];
+   va_list args;
+   va_start(args, format);
+   int length = vsnprintf(buf, sizeof(buf), format, args);
+   va_end(args);
+   if (length < 0) return 0;
+   if (length >= (int)sizeof(buf)) length = sizeof(buf) - 1;
+   return write((const uint8_t *)buf, length); }
+
+//-------------------------------------------------------
+//    EEPROM
+//-------------------------------------------------------
+
+EEPROMClass EEPROM;
+static uint8_t eeprom_data[E2END + 1];
+static int eeprom_fd = -1;
+
+static void eeprom_open(const char *filename) { // read the EEPROM file, or make a blank one
+   eeprom_fd = open(filename, O_RDWR | O_CREAT, 0644);
+   if (eeprom_fd < 0) {
+      fprintf(stderr, "can't open EEPROM file %s: %s\n", filename, strerror(errno));
+      exit(1); }
+   memset(eeprom_data, 0xff, sizeof(eeprom_data)); // (what an erased EEPROM reads)
+   ssize_t length = pread(eeprom_fd, eeprom_data, sizeof(eeprom_data), 0);
+   if (length < (ssize_t)sizeof(eeprom_data)
+         && pwrite(eeprom_fd, eeprom_data, sizeof(eeprom_data), 0) != sizeof(eeprom_data)) {
+      fprintf(stderr, "can't write EEPROM file %s: %s\n", filename, strerror(errno));
+      exit(1); } }
+
+uint8_t EEPROMClass::read(int addr) {
+   return addr >= 0 && addr <= E2END ? eeprom_data[addr] : 0; }
+
+void EEPROMClass::write(int addr, uint8_t val) {
+   if (addr < 0 || addr > E2END) return;
+   eeprom_data[addr] = val;
+   if (pwrite(eeprom_fd, &val, 1, addr) != 1)
+      fprintf(stderr, "can't write EEPROM file: %s\n", strerror(errno)); }
+
+//-------------------------------------------------------
+//    time and the realtime clock
+//-------------------------------------------------------
+
+static time_t time_offset = 0;  // what setTime() changed: now() - time()
+static time_t clock_offset = 0; // what Teensy3Clock.set() changed: its time - the local time
+teensy3_clock_class Teensy3Clock;
+
+time_t now(void) {
+   return time(NULL) + time_offset; }
+
+void setTime(time_t t) {
+   time_offset = t - time(NULL); }
+
+time_t makeTime(const TimeElements &tm) {
+   struct tm parts = {};
+   parts.tm_sec = tm.Second;
+   parts.tm_min = tm.Minute;
+   parts.tm_hour = tm.Hour;
+   parts.tm_mday = tm.Day;
+   parts.tm_mon = tm.Month - 1;
+   parts.tm_year = tm.Year + 70;
+   return timegm(&parts); }
+
+void breakTime(time_t time, TimeElements &tm) {
+   struct tm parts;
+   gmtime_r(&time, &parts);
+   tm.Second = parts.tm_sec;
+   tm.Minute = parts.tm_min;
+   tm.Hour = parts.tm_hour;
+   tm.Wday = parts.tm_wday + 1;
+   tm.Day = parts.tm_mday;
+   tm.Month = parts.tm_mon + 1;
+   tm.Year = parts.tm_year - 70; }
+
+void setSyncProvider(getExternalTime getTimeFunction) {
+   if (getTimeFunction) setTime(getTimeFunction()); }
+
+static time_t local_time(void) { // the host's time, in its time zone
+   time_t t = time(NULL);
+   struct tm parts;
+   localtime_r(&t, &parts);
+   return t + parts.tm_gmtoff; }
+
+unsigned long teensy3_clock_class::get(void) {
+   return local_time() + clock_offset; }
+
+void teensy3_clock_class::set(unsigned long t) {
+   clock_offset = t - local_time(); }
+
+//-------------------------------------------------------
+//    the WiFi "module"
+//-------------------------------------------------------
+
+SPIClass SPI;
+WiFiClass WiFi;
+static bool wifi_begun = false;
+static char wifi_ssid[33];
+static int server_fd = -1;
+static uint16_t server_port = 0; // from -p, if given
+static struct {
+   int fd;        // or -1 if the socket is free
+   bool accepted; // did it come from the server?
+} sockets[MAX_SOCK_NUM];
+
+static void host_wifi_reset(void) { // drop everything, as the module does when it's reset
+   for (int sock = 0; sock < MAX_SOCK_NUM; ++sock)
+      if (sockets[sock].fd >= 0) {
+         close(sockets[sock].fd);
+         sockets[sock].fd = -1; }
+   if (server_fd >= 0) close(server_fd);
+   server_fd = -1;
+   wifi_begun = false; }
+
+static int free_socket(void) {
+   for (int sock = 0; sock < MAX_SOCK_NUM; ++sock)
+      if (sockets[sock].fd < 0) return sock;
+   return -1; }
+
+int WiFiClass::begin(const char *ssid, const char *passphrase) {
+   snprintf(wifi_ssid, sizeof(wifi_ssid), "%s", ssid);
+   wifi_begun = true;
+   return WL_CONNECTED; }
+
+uint8_t WiFiClass::status(void) {
+   return wifi_begun ? WL_CONNECTED : WL_IDLE_STATUS; }
+
+uint8_t *WiFiClass::macAddress(uint8_t *mac) {
+   memset(mac, 0, 6);
+   return mac; }
+
+const char *WiFiClass::SSID(void) {
+   return wifi_begun ? wifi_ssid : ""; }
+
+IPAddress WiFiClass::localIP(void) { // (the server is on all of the host's addresses, including this one)
+   return IPAddress(127, 0, 0, 1); }
+
+void WiFiServer::begin(void) {
+   uint16_t port = server_port ? server_port : _port;
+   if (server_fd >= 0) close(server_fd);
+   server_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+   int on = 1;
+   setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+   struct sockaddr_in addr = {};
+   addr.sin_family = AF_INET;
+   addr.sin_addr.s_addr = htonl(INADDR_ANY);
+   addr.sin_port = htons(port);
+   if (bind(server_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(server_fd, 5) < 0) {
+      fprintf(stderr, "can't start the web server on port %d: %s\n", port, strerror(errno));
+      close(server_fd);
+      server_fd = -1; } }
+
+WiFiClient WiFiServer::available(uint8_t *status) {
+   static int next_sock = 0; // (so that one busy client doesn't hide the others)
+   if (status) *status = server_fd >= 0 ? 1 : CLOSED; // LISTEN or CLOSED
+   if (server_fd < 0) return WiFiClient();
+   int sock = free_socket();
+   if (sock >= 0) { // a new client?
+      int fd = accept4(server_fd, NULL, NULL, SOCK_NONBLOCK);
+      if (fd >= 0) {
+         sockets[sock].fd = fd;
+         sockets[sock].accepted = true;
+         return WiFiClient(sock); } }
+   for (int count = 0; count < MAX_SOCK_NUM; ++count) { // or one we have, with something to read
+      sock = next_sock;
+      next_sock = (next_sock + 1) % MAX_SOCK_NUM;
+      if (sockets[sock].fd >= 0 && sockets[sock].accepted && WiFiClient(sock).available() > 0)
+         return WiFiClient(sock); }
+   return WiFiClient(); }
+
+static int socket_fd(uint8_t sock) {
+   return sock < MAX_SOCK_NUM ? sockets[sock].fd : -1; }
+
+int WiFiClient::connect(const char *host, uint16_t port) {
+   stop();
+   int sock = free_socket();
+   if (sock < 0 || !wifi_begun) return 0;
+   struct addrinfo hints = {}, *addrs;
+   hints.ai_family = AF_INET;
+   hints.ai_socktype = SOCK_STREAM;
+   char portstr[8];
+   sprintf(portstr, "%u", port);
+   if (getaddrinfo(host, portstr, &hints, &addrs) != 0) return 0;
+   int fd = socket(AF_INET, SOCK_STREAM, 0);
+   struct timeval timeout = {CONNECT_TIMEOUT_SECS, 0 };
+   setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)); // (which limits connect() too)
+   bool ok = ::connect(fd, addrs->ai_addr, addrs->ai_addrlen) == 0;
+   freeaddrinfo(addrs);
+   if (!ok) {
+      close(fd);
+      return 0; }
+   sockets[sock].fd = fd;
+   sockets[sock].accepted = false;
+   _sock = sock;
+   return 1; }
+
+size_t WiFiClient::write(uint8_t b) {
+   return write(&b, 1); }
+
+size_t WiFiClient::write(const uint8_t *buf, size_t size) { // as much as fits, maybe none
+   int fd = socket_fd(_sock);
+   if (fd < 0) return 0;
+   ssize_t length = send(fd, buf, size, MSG_DONTWAIT | MSG_NOSIGNAL);
+   return length < 0 ? 0 : length; }
+
+int WiFiClient::available(void) {
+   int fd = socket_fd(_sock), count;
+   if (fd < 0 || ioctl(fd, FIONREAD, &count) < 0) return 0;
+   return count; }
+
+int WiFiClient::read(void) {
+   int fd = socket_fd(_sock);
+   uint8_t b;
+   return fd >= 0 && recv(fd, &b, 1, MSG_DONTWAIT) == 1 ? b : -1; }
+
+int WiFiClient::peek(void) {
+   int fd = socket_fd(_sock);
+   uint8_t b;
+   return fd >= 0 && recv(fd, &b, 1, MSG_DONTWAIT | MSG_PEEK) == 1 ? b : -1; }
+
+void WiFiClient::stop(void) {
+   int fd = socket_fd(_sock);
+   if (fd >= 0) {
+      close(fd);
+      sockets[_sock].fd = -1; }
+   _sock = NO_SOCKET_AVAIL; }
+
+uint8_t WiFiClient::connected(void) { // still connected, or has something left to read
+   int fd = socket_fd(_sock);
+   if (fd < 0) return false;
+   if (available() > 0) return true;
+   uint8_t b;
+   ssize_t length = recv(fd, &b, 1, MSG_DONTWAIT | MSG_PEEK);
+   return length > 0 || (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)); }
+
+uint8_t WiFiClient::status(void) {
+   return connected() ? ESTABLISHED : CLOSED; }
+
+IPAddress WiFiClient::remoteIP(void) {
+   struct sockaddr_in addr = {};
+   socklen_t length = sizeof(addr);
+   int fd = socket_fd(_sock);
+   if (fd < 0 || getpeername(fd, (struct sockaddr *)&addr, &length) < 0) return IPAddress();
+   return IPAddress((uint32_t)addr.sin_addr.s_addr); }
+
+uint16_t WiFiClient::remotePort(void) {
+   struct sockaddr_in addr = {};
+   socklen_t length = sizeof(addr);
+   int fd = socket_fd(_sock);
+   if (fd < 0 || getpeername(fd, (struct sockaddr *)&addr, &length) < 0) return 0;
+   return ntohs(addr.sin_port); }
+
+//-------------------------------------------------------
+//    running the controller
+//-------------------------------------------------------
+
+static void run_controller(void) {
+   sim_virtual_time(true); // (so the pauses for reading the display don't wait)
+   setup();
+   sim_virtual_time(false);
+   while (1) {
+      loop();
+      if (serial_input_ended && serial_input_next >= serial_input_length && !sim_busy()) {
+         fflush(stdout);
+         exit(0); } } }
+
+int main(int argc, char *argv[]) {
+   const char *eeprom_filename = "eeprom.bin";
+   int opt;
+   while ((opt = getopt(argc, argv, "e:p:")) != -1) {
+      if (opt == 'e') eeprom_filename = optarg;
+      else if (opt == 'p') server_port = atoi(optarg);
+      else {
+         fprintf(stderr, "usage: %s [-e eeprom_file] [-p port]\n", argv[0]);
+         return 1; } }
+   clock_gettime(CLOCK_MONOTONIC, &host_start_time);
+   setvbuf(stdout, NULL, _IOLBF, 0);
+   eeprom_open(eeprom_filename);
+   for (int sock = 0; sock < MAX_SOCK_NUM; ++sock) sockets[sock].fd = -1;
+
+   // Run the controller on a stack of its own, so we know where it is. (It never returns.)
+   static ucontext_t main_context, controller_context;
+   getcontext(&controller_context);
+   controller_context.uc_stack.ss_sp = host_stack;
+   controller_context.uc_stack.ss_size = STACK_SIZE;
+   controller_context.uc_link = &main_context;
+   makecontext(&controller_context, run_controller, 0);
+   swapcontext(&main_context, &controller_context);
+   return 0; }
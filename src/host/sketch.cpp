@@ -0,0 +1,6 @@
+// file: sketch.cpp
+// The main module, compiled the way the Arduino IDE does it: with prototypes of its functions
+// ahead of it, so they can be used before they are defined. The Makefile makes sketch_protos.h.
+#include "generator.h"
+#include "sketch_protos.h"
+#include "controller.ino"
@@ -0,0 +1,240 @@
+// file: logdecode.c
+/* ----------------------------------------------------------------------------------------
+   Decode the /log.bin dumps from generator controllers into one dataset
+
+   Each controller's web server returns its event log, configuration, and WiFi and IFTTT
+   counters at /log.bin, in the compact format described in genwifiserver.cpp. This program
+   reads any number of those dumps, from any number of sites, and writes:
+     - one CSV file of all the log entries, sorted by site and entry number, with the
+       duplicates removed, so overlapping dumps of the same site can just all be given
+     - optionally, another CSV file with the configuration and counters of each dump, one
+       "site,file,dump_time,name,value" row per item
+
+   usage: logdecode [-s sites.csv] dump.bin ... >events.csv
+
+   It's plain C with no dependencies, so compile it with whatever you have, for example
+      gcc -O -o logdecode logdecode.c
+   or "make logdecode" in src/host. "make test" there checks it against the host build's
+   web server, by decoding /log.bin and comparing the entries with /log.csv.
+
+   To collect from a controller:  curl -o site1.bin http://192.168.1.2/log.bin
+   or only what's new since entry S:  curl -o site1b.bin "http://192.168.1.2/log.bin?since=S"
+
+   See the controller's main module for other details and the change log.
+   ----------------------------------------------------------------------------------------
+   Copyright (c) 2026, the contributors to the generator controller (see its change log)
+   The MIT License (MIT)
+   Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+   and associated documentation files (the "Software"), to deal in the Software without
+   restriction, including without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+   Software is furnished to do so, subject to the following conditions:
+
+   The above copyright notice and this permission notice shall be included in all copies or
+   substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+   BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+   NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+   DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+   ------------------------------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+
+#define LOGBIN_VERSION 1   // the newest format we know
+#define ENTRY_MSGSIZE 20   // the msg in a logentry_t, which is not 0-terminated
+#define CONFIG_ID "GEN05"  // the config_hdr layout we know
+#define MAX_EVENT_TYPES 256
+
+struct entry_t {       // a log entry, from any dump
+   const char *site;
+   unsigned long num;
+   unsigned long time;
+   int type;
+   const char *event;  // the name of its type, or NULL
+   int extra_info;
+   char msg[ENTRY_MSGSIZE + 1]; };
+
+struct entry_t *entries = NULL;
+int num_entries = 0, max_entries = 0;
+FILE *sites_file = NULL;
+
+// A logentry_t is the time_t datetime, the byte event_type, the short extra_info, and the msg,
+// each aligned. The controller's time_t is 4 bytes, but the simulator's might be 8.
+
+#define CONFIG_TIME_OFFSET 20 // where config_hdr's time_t is, if it's 4 bytes; the fields after it
+                              // move with its alignment and size
+
+static const struct { // the config_hdr fields we show, for CONFIG_ID and a 4-byte time_t
+   const char *name;
+   int offset, size; }
+config_fields[] = {
+   {"gen_delay_mins", 6, 2 }, {"gen_run_mins", 8, 2 }, {"gen_rest_mins", 10, 2 },
+   {"gen_cooldown_mins", 12, 2 }, {"util_return_mins", 14, 2 }, {"exer_duration_mins", 16, 1 },
+   {"exer_wday", 17, 1 }, {"exer_hour", 18, 1 }, {"exer_weeks", 19, 1 }, {"exer_last", 20, 4 },
+   {"watchdog_max_msec", 24, 2 }, {"watchdog_max_activity", 26, 1 }, {"watchdog_reset_activity", 27, 1 },
+   {NULL } };
+
+void fatal(const char *msg, const char *info) {
+   fprintf(stderr, "%s%s\n", msg, info ? info : "");
+   exit(8); }
+
+unsigned long get_number(const unsigned char *ptr, int size) { // little-endian
+   unsigned long val = 0;
+   while (size--) val = (val << 8) | ptr[size];
+   return val; }
+
+const char *format_time(unsigned long secs) { // the controller's clock is local time, kept as if it were UTC
+   static char string[30];
+   time_t thetime = (time_t)secs;
+   struct tm *ptm = gmtime(&thetime);
+   if (!ptm) return "";
+   strftime(string, sizeof(string), "%Y-%m-%d %H:%M:%S", ptm);
+   return string; }
+
+void print_csv_string(FILE *file, const char *str) { // print a quoted string for CSV
+   putc('"', file);
+   for (; *str; ++str) {
+      if (*str == '"') putc('"', file); // (a quote is doubled)
+      putc(*str, file); }
+   putc('"', file); }
+
+void print_site_item(const char *site, const char *filename, unsigned long dump_time, const char *name, unsigned long val) {
+   print_csv_string(sites_file, site);
+   fprintf(sites_file, ",");
+   print_csv_string(sites_file, filename);
+   fprintf(sites_file, ",%s,%s,%lu\n", format_time(dump_time), name, val); }
+
+void add_entry(struct entry_t *pe) {
+   if (num_entries >= max_entries) {
+      max_entries = max_entries ? 2 * max_entries : 1000;
+      entries = realloc(entries, max_entries * sizeof(struct entry_t));
+      if (!entries) fatal("out of memory", NULL); }
+   entries[num_entries++] = *pe; }
+
+void decode_file(const char *filename) { // decode one dump, adding its entries to the list
+   FILE *file = fopen(filename, "rb");
+   if (!file) fatal("can't open ", filename);
+   fseek(file, 0, SEEK_END);
+   long length = ftell(file);
+   fseek(file, 0, SEEK_SET);
+   unsigned char *data = malloc(length + 1);
+   if (!data || fread(data, 1, length, file) != (size_t)length) fatal("can't read ", filename);
+   fclose(file);
+   // These are kept for the life of the program, since the entries point to them.
+   char *site = "";
+   const char *event_names[MAX_EVENT_TYPES] = {NULL };
+   unsigned long dump_time = 0, first_num = 0;
+   int entry_size = 0, time_size = 4, count = 0;
+   bool ended = false, first = true;
+   for (long pos = 0; !ended && pos < length; ) {
+      if (length - pos < 6) fatal("truncated section header in ", filename);
+      const char *tag = (const char *)data + pos;
+      unsigned section_length = get_number(data + pos + 4, 2);
+      unsigned char *section = data + pos + 6;
+      pos += 6 + section_length;
+      if (pos > length) fatal("truncated section in ", filename);
+      if (first) { // the first section must be GLOG
+         first = false;
+         if (strncmp(tag, "GLOG", 4) != 0 || section_length < 16) fatal("not a log dump: ", filename);
+         if (section[0] > LOGBIN_VERSION) fprintf(stderr, "%s is a newer format; decoding what we can\n", filename);
+         entry_size = section[1];
+         if (section[3]) time_size = section[3];
+         if (entry_size < time_size + 4 + ENTRY_MSGSIZE) fatal("log entries are too small in ", filename);
+         dump_time = get_number(section + 4, 4);
+         first_num = get_number(section + 12, 4); }
+      else if (strncmp(tag, "SITE", 4) == 0) {
+         site = malloc(section_length + 1);
+         memcpy(site, section, section_length);
+         site[section_length] = 0; }
+      else if (strncmp(tag, "CONF", 4) == 0 && sites_file) {
+         char id[7] = {0 };
+         memcpy(id, section, section_length < 6 ? section_length : 6);
+         int time_offset = (CONFIG_TIME_OFFSET + time_size - 1) / time_size * time_size;
+         if (strcmp(id, CONFIG_ID) != 0 || (time_size != 4 && time_size != 8)
+               || section_length < (unsigned)(28 - CONFIG_TIME_OFFSET - 4 + time_offset + time_size))
+            fprintf(stderr, "%s has configuration format \"%s\" with %d-byte times; skipping it\n", filename, id, time_size);
+         else for (int ndx = 0; config_fields[ndx].name; ++ndx) {
+               int offset = config_fields[ndx].offset, size = config_fields[ndx].size;
+               if (offset == CONFIG_TIME_OFFSET) offset = time_offset; // (and we use its low 4 bytes)
+               else if (offset > CONFIG_TIME_OFFSET) offset += time_offset + time_size - CONFIG_TIME_OFFSET - 4;
+               print_site_item(site, filename, dump_time, config_fields[ndx].name, get_number(section + offset, size)); } }
+      else if (strncmp(tag, "CNTR", 4) == 0 && sites_file) {
+         for (unsigned char *ptr = section; ptr < section + section_length; ) {
+            const char *name = (const char *)ptr;
+            ptr += strnlen(name, section + section_length - ptr) + 1;
+            if (ptr + 4 > section + section_length) break;
+            print_site_item(site, filename, dump_time, name, get_number(ptr, 4));
+            ptr += 4; } }
+      else if (strncmp(tag, "NAME", 4) == 0) {
+         int type = 0;
+         for (unsigned char *ptr = section; ptr < section + section_length && type < MAX_EVENT_TYPES; ++type) {
+            int namelength = strnlen((const char *)ptr, section + section_length - ptr);
+            char *name = malloc(namelength + 1);
+            memcpy(name, ptr, namelength);
+            name[namelength] = 0;
+            event_names[type] = name;
+            ptr += namelength + 1; } }
+      else if (strncmp(tag, "LOGE", 4) == 0) {
+         for (unsigned offset = 0; offset + entry_size <= section_length; offset += entry_size) {
+            unsigned char *ptr = section + offset;
+            struct entry_t entry;
+            entry.site = site;
+            entry.num = first_num + count++;
+            entry.time = get_number(ptr, time_size < 4 ? time_size : 4);
+            entry.type = ptr[time_size];
+            entry.event = event_names[entry.type];
+            entry.extra_info = (short)get_number(ptr + time_size + 2, 2);
+            memcpy(entry.msg, ptr + time_size + 4, ENTRY_MSGSIZE);
+            entry.msg[ENTRY_MSGSIZE] = 0;
+            add_entry(&entry); } }
+      else if (strncmp(tag, "END.", 4) == 0) ended = true;
+      // (and skip sections we don't know about)
+   }
+   free(data);
+   if (!ended) fprintf(stderr, "%s doesn't have the end; it may be incomplete\n", filename);
+   if (sites_file) print_site_item(site, filename, dump_time, "log_entries", count);
+   fprintf(stderr, "%s: site \"%s\", %d log entries\n", filename, site, count); }
+
+int compare_entries(const void *p1, const void *p2) { // by site, then number, then time
+   const struct entry_t *pe1 = p1, *pe2 = p2;
+   int diff = strcmp(pe1->site, pe2->site);
+   if (diff) return diff;
+   if (pe1->num != pe2->num) return pe1->num < pe2->num ? -1 : 1;
+   if (pe1->time != pe2->time) return pe1->time < pe2->time ? -1 : 1;
+   return 0; }
+
+int main(int argc, char **argv) {
+   int argnum = 1;
+   if (argc > 2 && strcmp(argv[1], "-s") == 0) {
+      sites_file = fopen(argv[2], "w");
+      if (!sites_file) fatal("can't create ", argv[2]);
+      fprintf(sites_file, "site,file,dump_time,name,value\n");
+      argnum = 3; }
+   if (argnum >= argc) {
+      fprintf(stderr, "usage: logdecode [-s sites.csv] dump.bin ... >events.csv\n");
+      return 4; }
+   for (; argnum < argc; ++argnum) decode_file(argv[argnum]);
+   if (num_entries > 0) qsort(entries, num_entries, sizeof(struct entry_t), compare_entries);
+   printf("site,num,time,datetime,type,event,extra_info,msg\n");
+   int duplicates = 0;
+   for (int ndx = 0; ndx < num_entries; ++ndx) {
+      struct entry_t *pe = &entries[ndx];
+      if (ndx > 0 && compare_entries(pe, pe - 1) == 0 && pe->type == pe[-1].type) { // from overlapping dumps
+         ++duplicates;
+         continue; }
+      print_csv_string(stdout, pe->site);
+      printf(",%lu,%lu,%s,%d,", pe->num, pe->time, format_time(pe->time), pe->type);
+      print_csv_string(stdout, pe->event ? pe->event : "");
+      printf(",%d,", pe->extra_info);
+      print_csv_string(stdout, pe->msg);
+      printf("\n"); }
+   fprintf(stderr, "%d log entries, %d duplicates removed\n", num_entries - duplicates, duplicates);
+   if (sites_file) fclose(sites_file);
+   return 0; }
+//*